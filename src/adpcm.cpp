@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "adpcm.h"
+
+static const int16_t step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+static const int8_t index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+// 8-bit unsigned PCM <-> 16-bit signed, the codec works on the latter
+static inline int16_t widen(uint8_t s) { return (int16_t)(((int)s - 128) << 8); }
+
+static inline uint8_t narrow(int32_t s)
+{
+    s = (s + 128) >> 8;
+    if (s < -128) s = -128;
+    if (s > 127)  s = 127;
+    return (uint8_t)(s + 128);
+}
+
+// Decode one nibble, updating predictor and step index
+static inline int32_t decode_nibble(uint8_t nibble, int32_t& predictor, int& index)
+{
+    const int32_t step = step_table[index];
+
+    int32_t diff = step >> 3;
+    if (nibble & 1) diff += step >> 2;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 4) diff += step;
+    if (nibble & 8) diff = -diff;
+
+    predictor += diff;
+    if (predictor < -32768) predictor = -32768;
+    if (predictor > 32767)  predictor = 32767;
+
+    index += index_table[nibble];
+    if (index < 0)  index = 0;
+    if (index > 88) index = 88;
+
+    return predictor;
+}
+
+size_t adpcm_block_samples(size_t len)
+{
+    return (len < 4) ? 0 : 1 + (len - 4) * 2;
+}
+
+size_t adpcm_encoded_size(size_t n)
+{
+    const size_t blocks = n / ADPCM_BLOCK_SAMPLES;
+    const size_t rest   = n % ADPCM_BLOCK_SAMPLES;
+    return blocks * ADPCM_BLOCK_ALIGN + (rest ? 4 + rest / 2 : 0);
+}
+
+size_t adpcm_encode_block(const uint8_t* pcm, size_t n, uint8_t* block, uint8_t& index)
+{
+    if (n == 0) {
+        return 0;
+    }
+
+    int32_t predictor = widen(pcm[0]);
+    int     idx       = index;
+
+    block[0] = predictor & 0xFF;
+    block[1] = (predictor >> 8) & 0xFF;
+    block[2] = idx;
+    block[3] = 0;
+
+    size_t out = 4;
+    for (size_t i = 1; i < n; ++i) {
+        // Quantize the difference to the step size, the decoder's arithmetic
+        // is replayed so both stay in sync
+        const int32_t step = step_table[idx];
+        int32_t diff = widen(pcm[i]) - predictor;
+
+        uint8_t nibble = 0;
+        if (diff < 0) {
+            nibble = 8;
+            diff   = -diff;
+        }
+        if (diff >= step)            { nibble |= 4; diff -= step; }
+        if (diff >= step >> 1)       { nibble |= 2; diff -= step >> 1; }
+        if (diff >= step >> 2)       { nibble |= 1; }
+
+        decode_nibble(nibble, predictor, idx);
+
+        if (i & 1) {
+            block[out] = nibble;
+        } else {
+            block[out++] |= nibble << 4;
+        }
+    }
+
+    // An even sample count leaves a lone low nibble
+    if (!(n & 1)) {
+        out++;
+    }
+
+    index = idx;
+    return out;
+}
+
+size_t adpcm_decode_block(const uint8_t* block, size_t len, size_t n, uint8_t* pcm)
+{
+    if (len < 4 || n == 0) {
+        return 0;
+    }
+    if (n > adpcm_block_samples(len)) {
+        n = adpcm_block_samples(len);
+    }
+
+    int32_t predictor = (int16_t)(block[0] | (block[1] << 8));
+    int     index     = block[2];
+    if (index > 88) {
+        index = 88;
+    }
+
+    pcm[0] = narrow(predictor);
+
+    for (size_t i = 1; i < n; ++i) {
+        const uint8_t byte = block[4 + (i - 1) / 2];
+        pcm[i] = narrow(decode_nibble((i & 1) ? byte & 0x0F : byte >> 4, predictor, index));
+    }
+
+    return n;
+}
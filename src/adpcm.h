@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// IMA-ADPCM (WAV format 0x11, mono)
+//
+// Samples can be stored as 4-bit IMA-ADPCM instead of 8-bit PCM, which halves
+// their size. The data is split into independent blocks of ADPCM_BLOCK_ALIGN
+// bytes: a 4 byte header (first sample and step index) followed by two
+// samples per byte, low nibble first. Blocks can be decoded on their own, so
+// playback can start anywhere on a block boundary and decoding costs a few
+// operations per sample.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "wav.h"
+
+#define ADPCM_BLOCK_ALIGN       256                                 // Bytes per block
+#define ADPCM_BLOCK_SAMPLES     (1 + (ADPCM_BLOCK_ALIGN - 4) * 2)   // Samples per block (505)
+
+// Number of samples in an encoded block of len bytes (the last block may be shorter)
+size_t adpcm_block_samples(size_t len);
+
+// Encoded size of n samples
+size_t adpcm_encoded_size(size_t n);
+
+// Encode n (<= ADPCM_BLOCK_SAMPLES) 8-bit unsigned samples into one block.
+// index carries the step index from block to block. Returns the block size.
+size_t adpcm_encode_block(const uint8_t* pcm, size_t n, uint8_t* block, uint8_t& index);
+
+// Decode a block of len bytes into at most n 8-bit unsigned samples, returns the
+// number of samples. n is the number of samples left in the clip: a last block
+// with an even sample count ends in a padding nibble that must not be played.
+size_t adpcm_decode_block(const uint8_t* block, size_t len, size_t n, uint8_t* pcm);
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <atomic>
+#include <cstring>
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+
+#include "adpcm.h"
+#include "audio.h"
+#include "audio_stream.h"
+#include "config.h"
+#include "mixer.h"
+
+// The built-in DAC is only reachable through I2S0. DAC1 (GPIO25) is fed by
+// the right channel, DAC2 (GPIO26) by the left one. I2S0 is also the only
+// way to capture the ADC continuously, so the sensor stays on timed reads.
+#define AUDIO_PORT I2S_NUM_0
+
+#if DAC_PIN == 25
+#define AUDIO_DAC_CHANNEL I2S_DAC_CHANNEL_RIGHT_EN
+#elif DAC_PIN == 26
+#define AUDIO_DAC_CHANNEL I2S_DAC_CHANNEL_LEFT_EN
+#else
+#error "DAC_PIN must be 25 or 26 (built-in DAC)"
+#endif
+
+#define AUDIO_REQUESTS 8     // Requests that can be pending until the next buffer
+
+// A request from audio_play()/audio_stop(), picked up by the audio task before each buffer
+struct AudioRequest {
+    const AudioClip* clip;
+    bool             stop;
+    uint32_t         seq;
+};
+
+static QueueHandle_t         requests      = nullptr;
+static SemaphoreHandle_t     request_mutex = nullptr;   // Keeps requests queued in seq order
+static std::atomic<uint32_t> request_seq{0};    // Incremented by every request
+static std::atomic<uint32_t> handled_seq{0};    // Last request the audio task has acted on
+static std::atomic<uint32_t> play_seq{0};       // Last play request
+
+static std::atomic<int>      active_voices{0};
+static std::atomic<uint32_t> started_seq{0};    // Last play request whose clip reached the DMA buffers
+static std::atomic<uint32_t> started_us{0};
+static std::atomic<uint32_t> steals{0};
+
+// Fill benchmark, [0] clips in RAM, [1] clips in flash, [2]/[3] the same for
+// ADPCM clips. Only written by the audio task.
+static volatile uint32_t fill_buffers[4]      = {};
+static volatile uint64_t fill_cycles_total[4] = {};
+static volatile uint32_t fill_cycles_max[4]   = {};
+
+static TaskHandle_t audio_task_handle = nullptr;
+
+// A clip being played. ADPCM clips are decoded one block at a time into
+// block_pcm. Blocks of streamed clips are gathered in block_in first, a
+// stream may deliver a block in several parts if it falls behind.
+struct Voice {
+    const AudioClip* clip;          // nullptr if the voice is free
+    size_t           pos;           // Read position in the clip's data
+    uint32_t         seq;           // Request that started it
+    bool             started;       // Reached the DMA buffers
+    uint8_t          block_in[ADPCM_BLOCK_ALIGN];
+    size_t           block_in_len;
+    uint8_t          block_pcm[ADPCM_BLOCK_SAMPLES];
+    size_t           block_pcm_len;
+    size_t           block_pcm_pos;
+};
+
+static Voice voices[AUDIO_VOICES];
+
+// One DMA buffer worth of stereo frames. The DAC takes the upper 8 bits of each
+// 16 bit sample, both channels carry the same sample.
+static uint16_t frames[AUDIO_DMA_FRAMES * 2];
+static uint8_t  pcm[AUDIO_DMA_FRAMES];      // PCM of one voice for the current buffer
+static int16_t  mix[AUDIO_DMA_FRAMES];      // Sum of all voices, relative to MIX_SILENCE
+
+// Copy up to n samples of the voice's clip to dst. Returns fewer samples at
+// the end of the clip or if a stream fell behind.
+static size_t read_clip(Voice& v, uint8_t* dst, size_t n)
+{
+    const AudioClip* clip = v.clip;
+
+    if (!clip->adpcm) {
+        if (n > clip->len - v.pos) {
+            n = clip->len - v.pos;
+        }
+        if (clip->stream) {
+            n = clip->stream->read(dst, n);
+        } else {
+            memcpy(dst, clip->data + v.pos, n);
+        }
+        v.pos += n;
+        return n;
+    }
+
+    size_t got = 0;
+    while (got < n) {
+        // Decode the next block
+        if (v.block_pcm_pos == v.block_pcm_len) {
+            const size_t start = v.pos - v.block_in_len;
+            if (start >= clip->len) {
+                break;
+            }
+            const size_t len = (clip->len - start < ADPCM_BLOCK_ALIGN) ? clip->len - start : ADPCM_BLOCK_ALIGN;
+
+            const uint8_t* block = clip->data + start;
+            if (clip->stream) {
+                const size_t r = clip->stream->read(v.block_in + v.block_in_len, len - v.block_in_len);
+                v.block_in_len += r;
+                v.pos          += r;
+                if (v.block_in_len < len) {
+                    break;
+                }
+                block          = v.block_in;
+                v.block_in_len = 0;
+            } else {
+                v.pos += len;
+            }
+
+            const size_t done = start / ADPCM_BLOCK_ALIGN * ADPCM_BLOCK_SAMPLES;
+            v.block_pcm_len = adpcm_decode_block(block, len, (clip->samples > done) ? clip->samples - done : 0, v.block_pcm);
+            v.block_pcm_pos = 0;
+            continue;
+        }
+
+        size_t c = v.block_pcm_len - v.block_pcm_pos;
+        if (c > n - got) {
+            c = n - got;
+        }
+        memcpy(dst + got, v.block_pcm + v.block_pcm_pos, c);
+        v.block_pcm_pos += c;
+        got             += c;
+    }
+
+    return got;
+}
+
+// Whether the voice has anything left to play
+static bool clip_remaining(const Voice& v)
+{
+    const AudioClip* clip = v.clip;
+    return clip && (clip->data || clip->stream) && (v.pos < clip->len || v.block_pcm_pos < v.block_pcm_len);
+}
+
+// Start clip on a free voice. If all voices are busy, the one that has been
+// playing the longest is cut off, it is the least noticeable one.
+static void start_voice(const AudioClip* clip, uint32_t seq)
+{
+    Voice* voice = nullptr;
+
+    // A stream has a single read position, restart the voice already playing it
+    if (clip->stream) {
+        for (Voice& v : voices) {
+            if (v.clip == clip) {
+                voice = &v;
+            }
+        }
+    }
+
+    for (Voice& v : voices) {
+        if (!voice && !v.clip) {
+            voice = &v;
+        }
+    }
+
+    if (!voice) {
+        uint32_t seq[AUDIO_VOICES];
+        for (int i = 0; i < AUDIO_VOICES; ++i) {
+            seq[i] = voices[i].seq;
+        }
+        voice = &voices[mix_oldest(seq, AUDIO_VOICES)];
+        steals.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    voice->clip          = clip;
+    voice->pos           = 0;
+    voice->seq           = seq;
+    voice->started       = false;
+    voice->block_in_len  = 0;
+    voice->block_pcm_len = 0;
+    voice->block_pcm_pos = 0;
+
+    if (clip->stream) {
+        clip->stream->restart();
+    }
+}
+
+static void audio_task(void*)
+{
+    for (;;) {
+        AudioRequest req;
+        while (xQueueReceive(requests, &req, 0) == pdTRUE) {
+            if (req.stop) {
+                for (Voice& v : voices) {
+                    if (!req.clip || v.clip == req.clip) {
+                        v.clip = nullptr;
+                    }
+                }
+            } else if (req.clip) {
+                start_voice(req.clip, req.seq);
+            }
+            handled_seq.store(req.seq, std::memory_order_release);
+        }
+
+        // Sum up the voices one buffer at a time, a stream may deliver less if it fell behind
+        memset(mix, 0, sizeof(mix));
+        int active = 0;
+
+        for (Voice& v : voices) {
+            if (!clip_remaining(v)) {
+                v.clip = nullptr;
+                continue;
+            }
+
+            const uint32_t start_cycles = ESP.getCycleCount();
+
+            const size_t n = read_clip(v, pcm, AUDIO_DMA_FRAMES);
+            mix_add(mix, pcm, n, v.clip->gain);
+
+            if (!v.clip->stream) {
+                const uint32_t cycles = ESP.getCycleCount() - start_cycles;
+                const int      src    = (v.clip->flash ? 1 : 0) + (v.clip->adpcm ? 2 : 0);
+
+                fill_cycles_total[src] = fill_cycles_total[src] + cycles;
+                if (cycles > fill_cycles_max[src]) {
+                    fill_cycles_max[src] = cycles;
+                }
+                fill_buffers[src] = fill_buffers[src] + 1;
+            }
+
+            active++;
+        }
+
+        // Saturate the sum to 8 bits, loud overlaps clip instead of wrapping around
+        mix_output(mix, frames, AUDIO_DMA_FRAMES);
+
+        active_voices.store(active, std::memory_order_relaxed);
+
+        // Blocks until the DMA has room for another buffer, which paces the task
+        size_t written = 0;
+        i2s_write(AUDIO_PORT, frames, sizeof(frames), &written, portMAX_DELAY);
+
+        const uint32_t now = micros();
+        for (Voice& v : voices) {
+            if (v.clip && !v.started) {
+                v.started = true;
+                if ((int32_t)(v.seq - started_seq.load(std::memory_order_relaxed)) > 0) {
+                    started_us.store(now, std::memory_order_relaxed);
+                    started_seq.store(v.seq, std::memory_order_release);
+                }
+            }
+        }
+    }
+}
+
+// Queue a request for the audio task, returns its sequence number
+static uint32_t send_request(const AudioClip* clip, bool stop)
+{
+    xSemaphoreTake(request_mutex, portMAX_DELAY);
+
+    AudioRequest req;
+    req.clip = clip;
+    req.stop = stop;
+    req.seq  = request_seq.load(std::memory_order_relaxed) + 1;
+
+    xQueueSend(requests, &req, portMAX_DELAY);
+    request_seq.store(req.seq, std::memory_order_release);
+    if (!stop) {
+        play_seq.store(req.seq, std::memory_order_release);
+    }
+
+    xSemaphoreGive(request_mutex);
+    return req.seq;
+}
+
+void audio_begin()
+{
+    if (audio_task_handle) {
+        return;
+    }
+
+    i2s_config_t cfg = {};
+    cfg.mode                 = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_DAC_BUILT_IN);
+    cfg.sample_rate          = SAMPLE_RATE;
+    cfg.bits_per_sample      = I2S_BITS_PER_SAMPLE_16BIT;
+    cfg.channel_format       = I2S_CHANNEL_FMT_RIGHT_LEFT;
+    cfg.communication_format = I2S_COMM_FORMAT_STAND_MSB;
+    cfg.dma_buf_count        = AUDIO_DMA_BUFFERS;
+    cfg.dma_buf_len          = AUDIO_DMA_FRAMES;
+    cfg.tx_desc_auto_clear   = true;    // Output silence instead of repeating old data if we ever fall behind
+
+    if (i2s_driver_install(AUDIO_PORT, &cfg, 0, nullptr) != ESP_OK) {
+        return;
+    }
+    i2s_set_pin(AUDIO_PORT, nullptr);   // Built-in DAC
+    i2s_set_dac_mode(AUDIO_DAC_CHANNEL);
+    i2s_zero_dma_buffer(AUDIO_PORT);
+
+    requests      = xQueueCreate(AUDIO_REQUESTS, sizeof(AudioRequest));
+    request_mutex = xSemaphoreCreateMutex();
+
+    xTaskCreatePinnedToCore(audio_task, "audio", AUDIO_TASK_STACK, nullptr,
+                            AUDIO_TASK_PRIORITY, &audio_task_handle, AUDIO_TASK_CORE);
+}
+
+void audio_play(const AudioClip* clip)
+{
+    if (audio_task_handle && clip) {
+        send_request(clip, false);
+    }
+}
+
+void audio_stop(const AudioClip* clip)
+{
+    if (!audio_task_handle) {
+        return;
+    }
+
+    // The task handles requests before filling the next buffer, so this takes at most one buffer
+    const uint32_t seq = send_request(clip, true);
+    while ((int32_t)(handled_seq.load(std::memory_order_acquire) - seq) < 0) {
+        vTaskDelay(1);
+    }
+}
+
+int audio_voices()
+{
+    return active_voices.load(std::memory_order_relaxed);
+}
+
+uint32_t audio_steals()
+{
+    return steals.load(std::memory_order_relaxed);
+}
+
+bool audio_clip_started(uint32_t& us)
+{
+    if (started_seq.load(std::memory_order_acquire) != play_seq.load(std::memory_order_acquire)) {
+        return false;
+    }
+    us = started_us.load(std::memory_order_relaxed);
+    return true;
+}
+
+AudioFillStats audio_fill_stats(bool flash, bool adpcm)
+{
+    const int src = (flash ? 1 : 0) + (adpcm ? 2 : 0);
+
+    AudioFillStats stats;
+    stats.buffers    = fill_buffers[src];
+    stats.cycles_avg = stats.buffers ? (uint32_t)(fill_cycles_total[src] / stats.buffers) : 0;
+    stats.cycles_max = fill_cycles_max[src];
+    return stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Audio output
+//
+// Streams 8-bit unsigned PCM at SAMPLE_RATE to the built-in DAC on DAC_PIN
+// through I2S DMA. A dedicated task keeps the DMA buffers filled, it blocks
+// in the I2S driver until a buffer becomes free, so playback doesn't depend
+// on anybody else polling and keeps going while WiFi, HTTP, OTA or logging
+// are busy. Silence (DAC midpoint) is output while no clip is playing.
+//
+// Up to AUDIO_VOICES clips play at the same time, so the sounds of coins
+// inserted in quick succession overlap instead of cutting each other off.
+// The voices are scaled by their clip's gain, summed a buffer at a time and
+// saturated to 8 bits.
+//
+// audio_play() and audio_stop() may be called from any task.
+
+#include <cstddef>
+#include <cstdint>
+
+#define AUDIO_GAIN_UNITY 256    // Clip gain of 1.0
+
+class AudioStream;
+
+// A clip is a plain view of PCM data, the engine never copies or frees it.
+// Clips too long for memory are streamed from a file instead (see audio_stream.h).
+// IMA-ADPCM clips (see adpcm.h) are decoded a block at a time while playing.
+struct AudioClip {
+    const uint8_t* data    = nullptr;   // 8-bit unsigned PCM, mono
+    size_t         len     = 0;         // Number of bytes in data or the stream
+    size_t         samples = 0;         // Number of samples in ADPCM data, the last block may hold one less than its size implies
+    bool           flash   = false;     // Data is read through the flash cache (memory-mapped partition)
+    bool           adpcm   = false;     // Data is IMA-ADPCM blocks instead of PCM
+    uint16_t       gain    = AUDIO_GAIN_UNITY;  // Volume applied while mixing
+    AudioStream*   stream  = nullptr;   // If set, PCM is read from this stream instead of data
+};
+
+void     audio_begin();                         // Install the I2S driver and start the audio task
+void     audio_play(const AudioClip* clip);     // Start playing clip from the beginning on a free voice, cutting off the oldest one if there is none
+void     audio_stop(const AudioClip* clip = nullptr);   // Stop the voices playing clip (all if nullptr), returns once the engine no longer reads it
+int      audio_voices();                        // Number of voices currently playing
+uint32_t audio_steals();                        // Number of clips cut off because all voices were busy
+bool     audio_clip_started(uint32_t& us);      // Whether the last clip reached the DMA buffers, us = micros() of its first buffer
+
+// CPU cycles spent converting a buffer of clip data, separately for clips in RAM
+// and in memory-mapped flash. The difference is the cost of flash cache misses.
+// ADPCM clips are counted separately, their cycles include decoding.
+struct AudioFillStats {
+    uint32_t buffers;
+    uint32_t cycles_avg;
+    uint32_t cycles_max;
+};
+AudioFillStats audio_fill_stats(bool flash, bool adpcm = false);
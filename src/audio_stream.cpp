@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "audio_stream.h"
+#include "config.h"
+
+static std::vector<AudioStream*> streams;                        // Open streams, served by the stream task
+static SemaphoreHandle_t         stream_mutex       = nullptr;  // Guards streams and the files while open()/close()/fill() run
+static TaskHandle_t              stream_task_handle = nullptr;
+
+static void wake_stream_task()
+{
+    if (stream_task_handle) {
+        xTaskNotifyGive(stream_task_handle);
+    }
+}
+
+// Keeps the read-ahead blocks of all open streams filled. Woken by the audio
+// task whenever it has consumed a block, polls every STREAM_POLL_MS otherwise.
+static void stream_task(void*)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_POLL_MS));
+
+        xSemaphoreTake(stream_mutex, portMAX_DELAY);
+        for (AudioStream* stream : streams) {
+            while (stream->fill());
+        }
+        xSemaphoreGive(stream_mutex);
+    }
+}
+
+void stream_begin()
+{
+    if (stream_task_handle) {
+        return;
+    }
+
+    stream_mutex = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(stream_task, "stream", STREAM_TASK_STACK, nullptr,
+                            STREAM_TASK_PRIORITY, &stream_task_handle, STREAM_TASK_CORE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Setup
+///////////////////////////////////////////////////////////////////////////////
+
+bool AudioStream::open(const char* path, size_t offset, size_t len)
+{
+    close();
+
+    if (!stream_mutex) {
+        return false;
+    }
+
+    xSemaphoreTake(stream_mutex, portMAX_DELAY);
+
+    file_ = LittleFS.open(path, "r");
+    if (!file_) {
+        xSemaphoreGive(stream_mutex);
+        return false;
+    }
+
+    offset_     = offset;
+    len_        = len;
+    block_size_ = STREAM_BLOCK_SIZE;
+    buf_.resize(3 * block_size_);
+
+    // The head block is read once and stays in RAM
+    head_len_ = (len < block_size_) ? len : block_size_;
+    file_.seek(offset_);
+    head_len_ = file_.read(buf_.data(), head_len_);
+
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    ack_gen_.store(restart_gen_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    file_pos_  = head_len_;
+    pos_       = 0;
+    block_pos_ = 0;
+    min_ahead_ = len_;
+    underruns_ = 0;
+    open_      = true;
+
+    streams.push_back(this);
+
+    xSemaphoreGive(stream_mutex);
+
+    // Read ahead right away, so the first playback doesn't depend on the stream task's timing
+    wake_stream_task();
+    return true;
+}
+
+void AudioStream::close()
+{
+    if (!open_) {
+        return;
+    }
+
+    xSemaphoreTake(stream_mutex, portMAX_DELAY);
+
+    streams.erase(std::remove(streams.begin(), streams.end(), this), streams.end());
+
+    file_.close();
+    std::vector<uint8_t>().swap(buf_);
+    open_ = false;
+
+    xSemaphoreGive(stream_mutex);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Audio task side
+///////////////////////////////////////////////////////////////////////////////
+
+void AudioStream::restart()
+{
+    // Still at the beginning, the read-ahead blocks are valid
+    if (pos_ == 0) {
+        return;
+    }
+
+    pos_       = 0;
+    block_pos_ = 0;
+    restart_gen_.fetch_add(1, std::memory_order_release);
+    wake_stream_task();
+}
+
+size_t AudioStream::read(uint8_t* dst, size_t n)
+{
+    if (!open_) {
+        return 0;
+    }
+
+    size_t got = 0;
+
+    while (got < n && pos_ < len_) {
+        // Head block
+        if (pos_ < head_len_) {
+            size_t c = head_len_ - pos_;
+            if (c > n - got) {
+                c = n - got;
+            }
+            memcpy(dst + got, buf_.data() + pos_, c);
+            pos_ += c;
+            got  += c;
+            continue;
+        }
+
+        // Read-ahead blocks, only valid once the stream task has caught up with the last restart
+        if (ack_gen_.load(std::memory_order_acquire) != restart_gen_.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        const size_t b = tail & 1;
+        size_t c = block_len_[b] - block_pos_;
+        if (c > n - got) {
+            c = n - got;
+        }
+        memcpy(dst + got, block(b) + block_pos_, c);
+        block_pos_ += c;
+        pos_       += c;
+        got        += c;
+
+        // Block used up, hand it back to the stream task
+        if (block_pos_ == block_len_[b]) {
+            block_pos_ = 0;
+            tail_.store(tail + 1, std::memory_order_release);
+            wake_stream_task();
+        }
+    }
+
+    if (got < n && pos_ < len_) {
+        underruns_ = underruns_ + 1;
+    }
+
+    // Track the low-water mark while there is more data to come than is buffered
+    const size_t ahead = read_ahead();
+    if (pos_ < len_ && len_ - pos_ > ahead && ahead < min_ahead_) {
+        min_ahead_ = ahead;
+    }
+
+    // Played to the end, read ahead for the next time right away
+    if (pos_ >= len_) {
+        restart();
+    }
+
+    return got;
+}
+
+size_t AudioStream::read_ahead() const
+{
+    size_t ahead = (pos_ < head_len_) ? head_len_ - pos_ : 0;
+
+    if (ack_gen_.load(std::memory_order_acquire) != restart_gen_.load(std::memory_order_relaxed)) {
+        return ahead;
+    }
+
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    const uint32_t head = head_.load(std::memory_order_acquire);
+    for (uint32_t i = tail; i != head; ++i) {
+        ahead += block_len_[i & 1];
+    }
+
+    return ahead - ((head != tail) ? block_pos_ : 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stream task side
+///////////////////////////////////////////////////////////////////////////////
+
+bool AudioStream::fill()
+{
+    // The audio task restarted the clip, drop what was read ahead from the old position.
+    // The audio task doesn't touch the blocks until the restart is acknowledged.
+    const uint32_t gen = restart_gen_.load(std::memory_order_acquire);
+    if (gen != ack_gen_.load(std::memory_order_relaxed)) {
+        head_.store(tail_.load(std::memory_order_acquire), std::memory_order_relaxed);
+        file_pos_ = head_len_;
+        ack_gen_.store(gen, std::memory_order_release);
+    }
+
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= 2 || file_pos_ >= len_) {
+        return false;
+    }
+
+    const size_t b = head & 1;
+    size_t n = len_ - file_pos_;
+    if (n > block_size_) {
+        n = block_size_;
+    }
+
+    file_.seek(offset_ + file_pos_);
+    n = file_.read(block(b), n);
+    if (n == 0) {
+        return false;
+    }
+
+    block_len_[b] = n;
+    file_pos_    += n;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
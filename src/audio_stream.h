@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Streaming clips
+//
+// Plays PCM straight from a LittleFS file, for clips too long to be kept in
+// RAM. The first STREAM_BLOCK_SIZE bytes stay in RAM, so playback starts
+// without waiting for the file system. The rest is read ahead into two
+// alternating blocks by the "stream" task while the audio task consumes the
+// other one. RAM use is three blocks per stream, regardless of clip length.
+//
+// The blocks are handed over like in SpscRing: the stream task only writes
+// head_, the audio task only writes tail_. Restarting playback is requested
+// by the audio task through restart_gen_ and acknowledged by the stream task
+// once it has discarded the blocks read ahead from the old position.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <FS.h>
+
+class AudioStream {
+public:
+    // Open path and stream len bytes starting at offset. Must not be called while the stream is playing.
+    bool open(const char* path, size_t offset, size_t len);
+    void close();
+    bool is_open() const { return open_; }
+
+    // Audio task side
+    void   restart();                       // Continue from the beginning of the clip
+    size_t read(uint8_t* dst, size_t n);    // Copy up to n bytes, fewer at the end or on underrun
+
+    // Stream task side: refill a free block, true if there was anything to do
+    bool fill();
+
+    size_t   read_ahead() const;                            // Bytes buffered ahead of the playback position
+    size_t   min_read_ahead() const { return min_ahead_; }  // Lowest read-ahead seen while playing
+    uint32_t underruns() const { return underruns_; }       // Reads that found no data although the clip wasn't over
+
+private:
+    uint8_t* block(size_t i) { return buf_.data() + (i + 1) * block_size_; }
+
+    File                 file_;
+    bool                 open_   = false;
+    size_t               offset_ = 0;       // Payload offset in the file
+    size_t               len_    = 0;       // Payload size
+    size_t               block_size_ = 0;
+    std::vector<uint8_t> buf_;              // Head block followed by the two read-ahead blocks
+    size_t               head_len_ = 0;     // Bytes in the head block
+
+    // Written by the stream task
+    std::atomic<uint32_t> head_{0};         // Blocks filled
+    std::atomic<uint32_t> ack_gen_{0};      // Last restart the stream task has caught up with
+    size_t                block_len_[2] = {};
+    size_t                file_pos_ = 0;    // Next payload byte to read
+
+    // Written by the audio task
+    std::atomic<uint32_t> tail_{0};         // Blocks consumed
+    std::atomic<uint32_t> restart_gen_{0};  // Incremented by restart()
+    size_t                pos_       = 0;   // Payload bytes played since the last restart
+    size_t                block_pos_ = 0;   // Bytes played from the current read-ahead block
+    size_t                min_ahead_ = 0;
+    volatile uint32_t     underruns_ = 0;
+};
+
+void stream_begin();    // Start the stream task
@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Exponential backoff
+//
+// Delays between retries of something that keeps failing, e.g. connecting
+// to WiFi (see wifi_poll() in main.cpp): min_ms after the first failure,
+// doubled after every further one, up to max_ms. A success starts over.
+
+#include <cstdint>
+
+class Backoff {
+public:
+    Backoff(uint32_t min_ms, uint32_t max_ms) : min_(min_ms), max_(max_ms), delay_(min_ms) {}
+
+    uint32_t delay() const { return delay_; }  // Delay before the next retry if this attempt fails
+    void     reset() { delay_ = min_; }         // After a success, or when starting over
+    void     grow();                            // Retrying after delay(), the next one is longer
+
+private:
+    uint32_t min_;
+    uint32_t max_;
+    uint32_t delay_;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+// Generated by tools/coin_template.py from adc_readings_coin.csv (4 coins), do not edit.
+// Average coin dip relative to the baseline, aligned on its minimum and
+// scaled to +-127. One value per COIN_TEMPLATE_PERIOD_US.
+
+#include <cstdint>
+
+#define COIN_TEMPLATE_PERIOD_US 8000
+
+const int8_t coin_template[] = { 40, 50, 4, -86, -127, -98, -39, -9, -5, -2 };
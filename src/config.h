@@ -29,7 +29,9 @@
 #define SSID "TUDOMakerspace"
 #define PASSWORD "diyordie"
 #define STATIC_IP 192, 168, 0, 31
-#define WIFI_CONNECT_TIMEOUT 5000 // ms
+#define WIFI_CONNECT_TIMEOUT 5000 // ms - Per connection attempt. Without a connection by then, the box starts detecting coins offline
+#define WIFI_RETRY_MIN 1000 // ms - Delay before retrying a failed connection, doubled after every failure
+#define WIFI_RETRY_MAX 60000 // ms - Longest delay between connection attempts
 #define BOOT_TIME 2
 // #define REACTIVATE_WIFI_AFTER 10000 // ms - Comment out to not reactivate WiFi automatically
 
@@ -38,6 +40,14 @@
 #define REACTIVATE_WIFI_AFTER 0
 #endif
 
+// DO NOT EDIT: Sanity check
+#if WIFI_CONNECT_TIMEOUT < BOOT_TIME * 1000
+#error "WIFI_CONNECT_TIMEOUT must be at least BOOT_TIME seconds"
+#endif
+#if WIFI_RETRY_MIN <= 0 || WIFI_RETRY_MIN > WIFI_RETRY_MAX
+#error "WIFI_RETRY_MIN must be above 0 and at most WIFI_RETRY_MAX"
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // Configuration
 ///////////////////////////////////////////////////////////////////////////////
@@ -48,11 +58,29 @@
 // Audio
 ///////////////////////////////////////////////////////////////////////////////
 
-#define DAC_PIN 25                                  // Pin used for audio output
-#define SAMPLE_RATE 16000                           // Sample rate (only used for sample size calculation)
-#define MAX_DURATION 3                              // Maximum duration of a sample in seconds
-#define SAMPLE_SIZE (SAMPLE_RATE * MAX_DURATION)    // Maximum sample size in bytes (16000 samples * 2 bytes/sample = 32000 bytes)
-#define N_SAMPLES 3                                 // Number of samples (probability decreases with higher index)
+#define DAC_PIN 25                                  // Pin used for audio output (25 or 26, built-in DAC)
+#define SAMPLE_RATE 16000                           // Sample rate of the samples and the audio output
+#define RESAMPLE_MIN_RATE 8000                      // Lowest sample rate accepted for uploads, other rates are converted to SAMPLE_RATE
+#define RESAMPLE_MAX_RATE 48000                     // Highest sample rate accepted for uploads
+#define AUDIO_DMA_BUFFERS 4                         // Number of I2S DMA buffers for audio output
+#define AUDIO_DMA_FRAMES 128                        // Samples per DMA buffer (8 ms at 16 kHz), the DMA queue adds up to AUDIO_DMA_BUFFERS of these to the latency
+#define AUDIO_VOICES 4                              // Number of samples that can play at the same time
+#define SAMPLE_PARTITION "samples"                  // Label of the flash partition samples are played from (see partitions.csv)
+#define SAMPLE_REGION_SIZE 0x10000                  // Bytes reserved per sample in that partition (multiple of 4 KB)
+#define MAX_DURATION 15                             // Maximum duration of a sample in seconds
+#define STREAM_ABOVE 49152                          // Samples larger than this (bytes) that don't fit the samples partition are streamed from LittleFS instead of loaded into RAM
+#define SAMPLE_CACHE_BUDGET 98304                   // Bytes of RAM for samples played from RAM (no samples partition), the least recently played ones are dropped above
+#define STREAM_BLOCK_SIZE 1024                      // Size of a streaming read-ahead block (64 ms at 16 kHz), three of them are kept in RAM per streamed sample
+#define STREAM_POLL_MS 10                           // Interval at which the stream task checks for free read-ahead blocks if not woken earlier
+#define UPLOAD_WRITE_BLOCK 4096                     // Converted uploads are written to LittleFS in blocks of this size (multiple of the 256 byte flash page, 0 writes every piece right away)
+#define UPLOAD_STALL_MS 10000                       // An upload that sent nothing for this long is dropped when another one starts, otherwise that one is rejected
+#define SAMPLE_SIZE (SAMPLE_RATE * MAX_DURATION)    // Maximum sample size in bytes (1 byte per sample)
+#define N_SAMPLES 3                                 // Number of built-in samples, the slots on first boot (probability decreases with higher index)
+#define MAX_SAMPLES 64                              // Maximum number of sample slots, more can be added at runtime by uploading (see docs/software.md)
+#define NEW_SAMPLE_WEIGHT 10                        // Weight of slots added by uploads, unless given (sample 0 starts with PROBABILITY_MAIN_SAMPLE)
+#define MAX_SAMPLE_WEIGHT 10000                     // Highest weight accepted for a slot, higher ones are rejected
+#define MAX_SAMPLE_GAIN 400                         // Highest gain accepted for an upload in percent, higher ones are rejected
+#define MANIFEST_PATH "/manifest"                   // LittleFS file listing the sample slots and their weights
 #define PROBABILITY_MAIN_SAMPLE 70                  // Probability of the main sample (sample 0). Remaining probability is distributed among the other samples.
 #define COOLDOWN 10                                 // Wait time after playback ends to prevent feedback loop
 #define ADC_IGNORE_ABOVE
@@ -63,6 +91,31 @@
 #error "PROBABILITY_MAIN_SAMPLE must be between 50 and 100"
 #endif
 
+// DO NOT EDIT: Sanity check for SAMPLE_CACHE_BUDGET, the pinned slot 0 and any other sample played from RAM must fit at once
+#if SAMPLE_CACHE_BUDGET < 2 * STREAM_ABOVE
+#error "SAMPLE_CACHE_BUDGET must be at least twice STREAM_ABOVE"
+#endif
+
+// DO NOT EDIT: Sanity check for UPLOAD_WRITE_BLOCK
+#if UPLOAD_WRITE_BLOCK % 256 != 0
+#error "UPLOAD_WRITE_BLOCK must be a multiple of 256"
+#endif
+
+// DO NOT EDIT: Sanity check for MAX_SAMPLE_GAIN, the voices are summed in 16 bits
+#if MAX_SAMPLE_GAIN * AUDIO_VOICES * 128 / 100 > 32767
+#error "MAX_SAMPLE_GAIN is too high for AUDIO_VOICES voices"
+#endif
+
+// DO NOT EDIT: Sanity check for NEW_SAMPLE_WEIGHT
+#if NEW_SAMPLE_WEIGHT > MAX_SAMPLE_WEIGHT
+#error "NEW_SAMPLE_WEIGHT must not exceed MAX_SAMPLE_WEIGHT"
+#endif
+
+// DO NOT EDIT: Sanity check for N_SAMPLES
+#if N_SAMPLES < 1 || N_SAMPLES > MAX_SAMPLES
+#error "N_SAMPLES must be between 1 and MAX_SAMPLES"
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // Sensor and Coin Detection
 ///////////////////////////////////////////////////////////////////////////////
@@ -71,11 +124,51 @@
 #define SPIKE_THRESHOLD     100     // Minimum ADC deviation from baseline to register a spike
 #define SPIKE_MAX_MS        90      // Spike must return to baseline within this time to count as a coin
 #define SAMPLE_PERIOD_US    2000    // Sensor sampling interval (500 Hz)
+#define SAMPLE_RING_SIZE    256     // Raw samples buffered between sampling timer and detector (power of two)
+#define SPIKE_NOISE_FACTOR  12      // Spike threshold as a multiple of the measured sensor noise, 0 = always use SPIKE_THRESHOLD
+#define SPIKE_THRESHOLD_MIN 60      // Lower bound of the noise derived spike threshold
+#define SPIKE_THRESHOLD_MAX 200     // Upper bound of the noise derived spike threshold
 #define LOW_THRESHOLD       7
 #define HIGH_THRESHOLD      750
 #define ADC_SAMPLES         4
 
 const float BASELINE_ALPHA = 0.02f;   // Baseline smoothing factor (0–1); lower = slower adaptation
+const float NOISE_ALPHA    = 0.005f;  // Noise estimate smoothing factor (0–1); lower = slower adaptation
+// #define DETECTOR_FLOAT_REFERENCE     // Uncomment to use the floating point baseline (reference for benchmarks)
+
+#define DETECTOR_MODE       DETECT_THRESHOLD    // DETECT_THRESHOLD or DETECT_MATCHED (matched filter, see detector.h)
+#define MATCH_CORRELATION   0.7f    // Minimum normalized correlation with the coin template (0–1)
+#define MATCH_MIN_DEPTH     60      // Minimum depth (ADC counts) of a matched coin dip
+
+///////////////////////////////////////////////////////////////////////////////
+// Tasks
+///////////////////////////////////////////////////////////////////////////////
+
+// Coin detection runs in a dedicated task. loop(), WiFi and AsyncTCP
+// are moved to core 0 via build flags in platformio.ini, so keep this on core 1.
+#define DETECT_TASK_CORE        1
+#define DETECT_TASK_PRIORITY    10
+#define DETECT_TASK_STACK       4096    // bytes
+
+// The audio task mostly sleeps in the I2S driver, waiting for a free DMA buffer.
+// It runs above the detection task so refilling a buffer is never delayed.
+#define AUDIO_TASK_CORE         1
+#define AUDIO_TASK_PRIORITY     12
+#define AUDIO_TASK_STACK        2048    // bytes
+
+// Reads streamed samples ahead from LittleFS. Below the audio task, but above
+// detection, which has plenty of slack in the sample ring.
+#define STREAM_TASK_CORE        1
+#define STREAM_TASK_PRIORITY    11
+#define STREAM_TASK_STACK       4096    // bytes
+
+// Loads the samples while the boot window is open, afterwards it reads the
+// samples played from RAM when they are picked. Next to loop() and WiFi on
+// core 0, at the priority of loop().
+#define LOAD_TASK_CORE          0
+#define LOAD_TASK_PRIORITY      1
+#define LOAD_TASK_STACK         6144    // bytes, LittleFS calls and sample conversion
+#define LOAD_QUEUE_LEN          4       // Picked samples waiting to be read into RAM by the load task
 
 ///////////////////////////////////////////////////////////////////////////////
 // Debugging
@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "coin_template.h"
+#include "detector.h"
+
+#define BASELINE_Q 16   // Fractional bits of the fixed point baseline
+
+CoinDetector::CoinDetector(Clock& clock, const DetectorConfig& config)
+    : clock_(clock)
+{
+    configure(config);
+}
+
+void CoinDetector::configure(const DetectorConfig& config)
+{
+    config_ = config;
+
+    if (config_.adc_samples == 0) {
+        config_.adc_samples = 1;
+    }
+
+    alpha_q_ = (int32_t)(config_.baseline_alpha * (1 << BASELINE_Q) + 0.5f);
+    noise_alpha_q_  = (int32_t)(config_.noise_alpha * (1 << BASELINE_Q) + 0.5f);
+    noise_factor_q_ = (int32_t)(config_.spike_noise_factor * 256.0f + 0.5f);
+
+    // Averaging reduces to a shift when adc_samples is a power of two
+    avg_shift_ = -1;
+    if ((config_.adc_samples & (config_.adc_samples - 1)) == 0) {
+        avg_shift_ = __builtin_ctz(config_.adc_samples);
+    }
+
+    sum_    = 0;
+    summed_ = 0;
+
+    // Start out with the fixed threshold, the noise estimate takes over once it settles
+    spike_threshold_ = config_.spike_threshold;
+    noise_ = noise_factor_q_ ? (int32_t)(((int64_t)config_.spike_threshold << (BASELINE_Q + 8)) / noise_factor_q_) : 0;
+
+    load_template();
+}
+
+// Resample the coin template to the averaged sample period and precompute its energy terms
+void CoinDetector::load_template()
+{
+    const size_t   n      = sizeof(coin_template) / sizeof(coin_template[0]);
+    const uint32_t period = config_.sample_period_us * config_.adc_samples;
+
+    tmpl_len_ = (uint64_t)(n - 1) * COIN_TEMPLATE_PERIOD_US / period + 1;
+    if (tmpl_len_ > MAX_TEMPLATE) {
+        tmpl_len_ = MAX_TEMPLATE;
+    }
+
+    int64_t energy = 0;
+    for (size_t k = 0; k < tmpl_len_; ++k) {
+        // Position in the original template in 1/256 steps, linear interpolation
+        const uint32_t pos  = (uint64_t)k * period * 256 / COIN_TEMPLATE_PERIOD_US;
+        const size_t   i    = pos >> 8;
+        const int32_t  frac = pos & 0xFF;
+        const int32_t  a    = coin_template[i];
+        const int32_t  b    = (i + 1 < n) ? coin_template[i + 1] : a;
+
+        tmpl_[k] = a + (((b - a) * frac) >> 8);
+        energy  += (int32_t)tmpl_[k] * tmpl_[k];
+    }
+
+    // A window x matches if corr = sum(t*x) satisfies
+    //   corr * 127 >= match_min_depth * sum(t^2)                (fitted depth)
+    //   corr^2     >= match_correlation^2 * sum(t^2) * sum(x^2) (shape)
+    const int64_t ncc2_q16 = (int64_t)(config_.match_correlation * config_.match_correlation * 65536.0f);
+    tmpl_min_energy_ = energy * config_.match_min_depth;
+    tmpl_ncc_energy_ = (ncc2_q16 * energy) >> 16;
+
+    reset_window();
+}
+
+void CoinDetector::reset_window()
+{
+    for (size_t i = 0; i < MAX_TEMPLATE; ++i) {
+        window_[i] = 0;
+    }
+    window_pos_    = 0;
+    window_fill_   = 0;
+    window_energy_ = 0;
+    last_corr_     = 0;
+    armed_         = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Baseline arithmetic
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef DETECTOR_FLOAT_REFERENCE
+
+CoinDetector::baseline_t CoinDetector::baseline_from(unsigned int v) const { return v; }
+int16_t CoinDetector::baseline_int() const  { return (int16_t)baseline_; }
+float CoinDetector::baseline() const        { return baseline_; }
+
+bool CoinDetector::baseline_outside() const
+{
+    return baseline_ < config_.low_threshold || baseline_ > config_.high_threshold;
+}
+
+void CoinDetector::baseline_update(unsigned int v)
+{
+    baseline_ += config_.baseline_alpha * ((float)v - baseline_);
+}
+
+#else
+
+// The EMA multiplies by baseline_alpha in Q16 and shifts back, which yields
+// the same decisions as the float reference on the recorded measurements.
+
+CoinDetector::baseline_t CoinDetector::baseline_from(unsigned int v) const { return (int32_t)v << BASELINE_Q; }
+int16_t CoinDetector::baseline_int() const  { return (int16_t)(baseline_ >> BASELINE_Q); }
+float CoinDetector::baseline() const        { return (float)baseline_ / (1 << BASELINE_Q); }
+
+bool CoinDetector::baseline_outside() const
+{
+    return baseline_ < ((int32_t)config_.low_threshold << BASELINE_Q) ||
+           baseline_ > ((int32_t)config_.high_threshold << BASELINE_Q);
+}
+
+void CoinDetector::baseline_update(unsigned int v)
+{
+    baseline_ += (int32_t)(((int64_t)(baseline_from(v) - baseline_) * alpha_q_) >> BASELINE_Q);
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Noise estimation
+///////////////////////////////////////////////////////////////////////////////
+
+// EMA of |diff|, fed with quiet readings only. Deviations are clipped to the
+// current spike threshold so the slopes of a coin barely move the estimate.
+void CoinDetector::noise_update(int16_t diff)
+{
+    int32_t dev = diff < 0 ? -diff : diff;
+    if (dev > spike_threshold_) {
+        dev = spike_threshold_;
+    }
+
+    noise_ += (int32_t)(((((int64_t)dev << BASELINE_Q) - noise_) * noise_alpha_q_) >> BASELINE_Q);
+
+    if (!noise_factor_q_) {
+        return;
+    }
+
+    int32_t threshold = (int32_t)(((int64_t)noise_ * noise_factor_q_) >> (BASELINE_Q + 8));
+    if (threshold < config_.spike_threshold_min) {
+        threshold = config_.spike_threshold_min;
+    } else if (threshold > config_.spike_threshold_max) {
+        threshold = config_.spike_threshold_max;
+    }
+    spike_threshold_ = threshold;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Detection
+///////////////////////////////////////////////////////////////////////////////
+
+bool CoinDetector::poll(AdcSource& source, bool update_baseline)
+{
+    AdcSample sample;
+    bool coin_hit = false;
+
+    while (source.read(sample)) {
+        coin_hit |= feed(sample, update_baseline);
+    }
+
+    return coin_hit;
+}
+
+bool CoinDetector::feed(const AdcSample& sample, bool update_baseline)
+{
+    raw_history.push(sample.raw);
+
+    sum_ += sample.raw;
+
+    // Keep accumulating until adc_samples raw values are summed up
+    if (++summed_ < config_.adc_samples) {
+        return false;
+    }
+
+    unsigned int read = (avg_shift_ >= 0) ? sum_ >> avg_shift_ : sum_ / config_.adc_samples;
+    sum_    = 0;
+    summed_ = 0;
+
+    avg_history.push(read);
+
+    const uint32_t start_cycles = clock_.cycles();
+    bool coin_hit = process(read, sample.t_us, update_baseline);
+    const uint32_t cycles = clock_.cycles() - start_cycles;
+
+    cycles_total_ += cycles;
+    if (cycles > cycles_max_) {
+        cycles_max_ = cycles;
+    }
+    runs_++;
+
+    return coin_hit;
+}
+
+// Run one averaged reading through the coin detection state machine
+// All timing is derived from the sample timestamps, not from when they are processed.
+bool CoinDetector::process(unsigned int read, uint32_t now_us, bool update_baseline)
+{
+    bool coin_hit = false;
+
+    if (!baseline_init_) {
+        baseline_ = baseline_from(read);
+        last_read_ = read;
+        baseline_init_ = true;
+    }
+
+    int16_t diff = (int16_t)read - baseline_int();
+    const bool outside = baseline_outside() ||
+                         read < config_.low_threshold || read > config_.high_threshold;
+
+    if (config_.mode == DETECT_MATCHED) {
+        coin_hit = process_matched(read, diff, outside, now_us);
+    } else {
+        coin_hit = process_threshold(read, diff, outside, now_us);
+    }
+
+    if ((state_ == IDLE || state_ == BLOCKING) && update_baseline) {
+        baseline_update(read);
+    }
+
+    if (state_ == IDLE && !outside && update_baseline) {
+        noise_update(diff);
+    }
+
+    last_read_ = read;
+
+    return coin_hit;
+}
+
+// Threshold detector: drop below and rise above spike_threshold within spike_max_ms
+bool CoinDetector::process_threshold(unsigned int read, int16_t diff, bool outside, uint32_t now_us)
+{
+    bool coin_hit = false;
+
+    switch (state_) {
+    case BLOCKING:
+        if (outside) {
+            block_start_us_ = now_us;
+        }
+        else if (now_us - block_start_us_ >= config_.block_after_ms * 1000UL) {
+            state_ = IDLE;
+            emit(REACTIVATED, read, diff, now_us);
+        }
+        break;
+    case IDLE:
+        // If we're outside the thresholds, the lid is likely open
+        if (outside) {
+            state_ = BLOCKING;
+            block_start_us_ = now_us;
+            emit(LID_OPEN_THRESHOLD, read, diff, now_us);
+            break;
+        }
+
+        // If the difference is above the threshold, start a spike
+        if (diff < -(int16_t)spike_threshold_) {
+            state_ = SPIKE_START;
+            spike_start_us_ = now_us;
+        }
+        break;
+
+    case SPIKE_START: {
+        // Spike within time threshold
+        int16_t updiff = (int16_t)read - (int16_t)last_read_;
+
+        if (updiff > (int16_t)spike_threshold_) {
+            state_ = SPIKE_END;
+        }
+        // Discard spikes that last too long
+        else if (now_us - spike_start_us_ > config_.spike_max_ms * 1000UL) {
+            state_ = BLOCKING;
+            block_start_us_ = now_us;
+            emit(LID_OPEN_SPIKE, read, diff, now_us);
+        }
+        break;
+    }
+    case SPIKE_END:
+        coin_hit = true;
+        state_ = IDLE;
+        emit(COIN_DETECTED, read, diff, now_us);
+        break;
+    }
+
+    return coin_hit;
+}
+
+// Matched filter detector: correlate the recent readings against the coin template
+bool CoinDetector::process_matched(unsigned int read, int16_t diff, bool outside, uint32_t now_us)
+{
+    switch (state_) {
+    case BLOCKING:
+        if (outside) {
+            block_start_us_ = now_us;
+        }
+        else if (now_us - block_start_us_ >= config_.block_after_ms * 1000UL) {
+            state_ = IDLE;
+            reset_window();
+            emit(REACTIVATED, read, diff, now_us);
+        }
+        return false;
+    case IDLE:
+    case SPIKE_START:
+    case SPIKE_END:
+        break;
+    }
+
+    // If we're outside the thresholds, the lid is likely open
+    if (outside) {
+        state_ = BLOCKING;
+        block_start_us_ = now_us;
+        emit(LID_OPEN_THRESHOLD, read, diff, now_us);
+        return false;
+    }
+
+    // Deviations lasting longer than any coin also indicate an open lid.
+    // SPIKE_START marks an ongoing deviation, which also freezes the baseline.
+    if (diff < -(int16_t)spike_threshold_) {
+        if (state_ != SPIKE_START) {
+            state_ = SPIKE_START;
+            spike_start_us_ = now_us;
+        } else if (now_us - spike_start_us_ > config_.spike_max_ms * 1000UL) {
+            state_ = BLOCKING;
+            block_start_us_ = now_us;
+            emit(LID_OPEN_SPIKE, read, diff, now_us);
+            return false;
+        }
+    } else {
+        state_ = IDLE;
+    }
+
+    // Slide the window: replace the oldest reading with the newest one
+    const int16_t old = window_[window_pos_];
+    window_energy_ -= (int32_t)old * old;
+    window_energy_ += (int32_t)diff * diff;
+    window_[window_pos_]   = diff;
+    window_t_[window_pos_] = now_us;
+    window_pos_ = (window_pos_ + 1 == tmpl_len_) ? 0 : window_pos_ + 1;
+
+    if (window_fill_ < tmpl_len_) {
+        window_fill_++;
+        return false;
+    }
+
+    // Oldest reading lines up with the start of the template
+    int64_t corr = 0;
+    size_t  w    = window_pos_;
+    for (size_t k = 0; k < tmpl_len_; ++k) {
+        corr += (int32_t)tmpl_[k] * window_[w];
+        w = (w + 1 == tmpl_len_) ? 0 : w + 1;
+    }
+
+    const bool match = corr > 0 &&
+                       corr * 127 >= tmpl_min_energy_ &&
+                       corr * corr >= tmpl_ncc_energy_ * window_energy_;
+
+    // Report the coin once the correlation has peaked
+    if (armed_ && corr < last_corr_) {
+        spike_start_us_ = window_t_[window_pos_];
+        emit(COIN_DETECTED, read, diff, now_us);
+
+        // Start over so the same coin can't match again
+        state_ = IDLE;
+        reset_window();
+        return true;
+    }
+
+    armed_     = match;
+    last_corr_ = corr;
+    return false;
+}
+
+void CoinDetector::emit(DetectorEvent event, unsigned int read, int16_t diff, uint32_t now_us)
+{
+    if (!handler_) {
+        return;
+    }
+
+    DetectorEventInfo info;
+    info.t_us           = now_us;
+    info.spike_start_us = spike_start_us_;
+    info.read           = read;
+    info.baseline       = baseline();
+    info.diff           = diff;
+    handler_(event, info);
+}
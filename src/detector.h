@@ -0,0 +1,187 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Coin detector
+//
+// Averages ADC_SAMPLES raw readings, tracks a slowly adapting baseline and
+// runs the coin state machine on the averaged stream: a coin causes a drop
+// of more than spike_threshold below the baseline, followed by a rise of more
+// than spike_threshold within spike_max_ms. Readings outside of the low/high
+// thresholds or overlong spikes indicate an open lid and block detection for
+// block_after_ms.
+//
+// The detector also estimates the sensor noise online as the mean absolute
+// deviation of the averaged readings from the baseline (an EMA, O(1) per
+// sample). With spike_noise_factor set, the spike threshold follows that
+// estimate, clamped to spike_threshold_min..spike_threshold_max, so boxes with
+// different lighting and enclosures converge to their own threshold.
+//
+// In DETECT_MATCHED mode, the averaged stream (relative to the baseline) is
+// instead correlated against a coin template recorded from real coins (see
+// coin_template.h). A coin is reported at the correlation peak if the window
+// matches the template's shape (normalized correlation >= match_correlation)
+// and its fitted depth is at least match_min_depth. The correlation is done
+// incrementally in fixed point, O(template length) per averaged sample.
+//
+// The detector only depends on the interfaces in hal.h, so the very same code
+// runs on the device and in the native replay build (see src/native/).
+
+#include <cstdint>
+
+#include "config.h"
+#include "hal.h"
+#include "ring_buffer.h"
+
+enum DetectorMode {
+    DETECT_THRESHOLD,   // Drop below and rise above spike_threshold
+    DETECT_MATCHED      // Matched filter against the recorded coin template
+};
+
+// Tunable detection parameters, defaults come from config.h
+struct DetectorConfig {
+    DetectorMode mode        = DETECTOR_MODE;
+    uint16_t spike_threshold = SPIKE_THRESHOLD;     // Fixed threshold, starting point of the adaptive one
+    float    spike_noise_factor  = SPIKE_NOISE_FACTOR;  // 0 = fixed spike_threshold
+    uint16_t spike_threshold_min = SPIKE_THRESHOLD_MIN;
+    uint16_t spike_threshold_max = SPIKE_THRESHOLD_MAX;
+    float    noise_alpha     = NOISE_ALPHA;
+    uint32_t spike_max_ms    = SPIKE_MAX_MS;
+    uint16_t low_threshold   = LOW_THRESHOLD;
+    uint16_t high_threshold  = HIGH_THRESHOLD;
+    uint32_t block_after_ms  = BLOCK_AFTER_LID_OPEN;
+    uint8_t  adc_samples     = ADC_SAMPLES;
+    float    baseline_alpha  = BASELINE_ALPHA;
+    uint32_t sample_period_us = SAMPLE_PERIOD_US;   // Raw sample period, used to scale the coin template
+    float    match_correlation = MATCH_CORRELATION;
+    uint16_t match_min_depth   = MATCH_MIN_DEPTH;
+};
+
+// Notable state changes, reported through the event handler
+enum DetectorEvent {
+    COIN_DETECTED,      // A coin passed the sensor
+    LID_OPEN_THRESHOLD, // Sensor left the low/high thresholds, detection blocked
+    LID_OPEN_SPIKE,     // Spike lasted longer than spike_max_ms, detection blocked
+    REACTIVATED         // Detection unblocked again
+};
+
+// Detector state at the time of an event
+struct DetectorEventInfo {
+    uint32_t t_us;              // Timestamp of the sample that caused the event
+    uint32_t spike_start_us;    // Timestamp of the sample that started the last spike
+    uint16_t read;              // Averaged reading
+    float    baseline;          // Baseline at the time of the event
+    int16_t  diff;              // Averaged reading minus baseline
+};
+
+typedef void (*DetectorEventHandler)(DetectorEvent event, const DetectorEventInfo& info);
+
+class CoinDetector {
+public:
+    enum State { BLOCKING, IDLE, SPIKE_START, SPIKE_END };
+
+    explicit CoinDetector(Clock& clock, const DetectorConfig& config = DetectorConfig());
+
+    void configure(const DetectorConfig& config);
+    const DetectorConfig& config() const { return config_; }
+    void on_event(DetectorEventHandler handler) { handler_ = handler; }
+
+    // Run a single raw sample through averaging and the state machine.
+    // Returns true if a coin was detected. The baseline is frozen while
+    // update_baseline is false (e.g. during playback).
+    bool feed(const AdcSample& sample, bool update_baseline = true);
+
+    // Feed all samples pending in source, returns true if any of them completed a coin
+    bool poll(AdcSource& source, bool update_baseline = true);
+
+    State state() const { return state_; }
+    float baseline() const;
+    float noise() const { return (float)noise_ / 65536.0f; }     // Mean absolute deviation from the baseline
+    uint16_t spike_threshold() const { return spike_threshold_; } // Spike threshold currently in use
+
+    // Benchmark counters, covering the processing of each averaged sample
+    uint32_t runs() const { return runs_; }
+    uint32_t cycles_avg() const { return runs_ ? cycles_total_ / runs_ : 0; }
+    uint32_t cycles_max() const { return cycles_max_; }
+
+    // Recent raw and averaged readings for debugging
+    RingBuffer<uint16_t, LOG_ADC_VALUES> raw_history;
+    RingBuffer<uint16_t, LOG_ADC_AVG_VALUES> avg_history;
+
+private:
+#ifdef DETECTOR_FLOAT_REFERENCE
+    typedef float baseline_t;   // Floating point reference implementation
+#else
+    typedef int32_t baseline_t; // Q16.16 fixed point
+#endif
+
+    static const size_t MAX_TEMPLATE = 32;
+
+    bool process(unsigned int read, uint32_t now_us, bool update_baseline);
+    bool process_threshold(unsigned int read, int16_t diff, bool outside, uint32_t now_us);
+    bool process_matched(unsigned int read, int16_t diff, bool outside, uint32_t now_us);
+    void load_template();
+    void reset_window();
+    void noise_update(int16_t diff);
+    void emit(DetectorEvent event, unsigned int read, int16_t diff, uint32_t now_us);
+
+    baseline_t baseline_from(unsigned int v) const;
+    int16_t    baseline_int() const;
+    bool       baseline_outside() const;
+    void       baseline_update(unsigned int v);
+
+    Clock&               clock_;
+    DetectorConfig       config_;
+    DetectorEventHandler handler_ = nullptr;
+
+    int32_t  alpha_q_   = 0;     // baseline_alpha in Q16
+    int      avg_shift_ = -1;    // log2(adc_samples) if it is a power of two, -1 otherwise
+    int32_t  noise_alpha_q_  = 0;    // noise_alpha in Q16
+    int32_t  noise_factor_q_ = 0;    // spike_noise_factor in Q8
+
+    State        state_          = IDLE;
+    baseline_t   baseline_       = 0;
+    bool         baseline_init_  = false;
+    uint32_t     spike_start_us_ = 0;
+    uint32_t     block_start_us_ = 0;
+    unsigned int sum_            = 0;
+    unsigned int summed_         = 0;
+    uint16_t     last_read_      = 0;
+    int32_t      noise_          = 0;   // Noise estimate in Q16.16
+    uint16_t     spike_threshold_ = 0;
+
+    // Matched filter
+    int16_t  tmpl_[MAX_TEMPLATE]     = {};  // Template resampled to the averaged sample period
+    size_t   tmpl_len_               = 0;
+    int64_t  tmpl_min_energy_        = 0;   // Template energy scaled by match_min_depth
+    int64_t  tmpl_ncc_energy_        = 0;   // Template energy scaled by match_correlation^2
+    int16_t  window_[MAX_TEMPLATE]   = {};  // Recent readings relative to the baseline
+    uint32_t window_t_[MAX_TEMPLATE] = {};  // Their timestamps
+    size_t   window_pos_             = 0;   // Oldest entry / next write position
+    size_t   window_fill_            = 0;   // Valid entries in window_
+    uint32_t window_energy_          = 0;   // Sum of squares of window_
+    int64_t  last_corr_              = 0;   // Correlation of the previous sample
+    bool     armed_                  = false; // Current window matches, waiting for the peak
+
+    uint32_t cycles_total_ = 0;
+    uint32_t cycles_max_   = 0;
+    uint32_t runs_         = 0;
+};
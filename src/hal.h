@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Platform interfaces used by the coin detector
+//
+// The detector itself doesn't touch any ESP32 or Arduino API. The firmware
+// implements these on top of the sampler and the CPU cycle counter, the
+// native replay build implements them on top of CSV recordings.
+
+#include <cstdint>
+
+struct AdcSample {
+    uint32_t t_us;  // Timestamp of the reading in microseconds
+    uint16_t raw;   // Raw 12-bit ADC value
+};
+
+// Source of timestamped raw ADC samples
+class AdcSource {
+public:
+    virtual ~AdcSource() {}
+    virtual bool read(AdcSample& sample) = 0; // Fetch the next sample, false if none is pending
+};
+
+// Free running cycle counter, used to benchmark the detector
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual uint32_t cycles() = 0;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Fixed-bucket latency histogram
+//
+// Records durations in microseconds into a small set of logarithmically
+// spaced buckets. Recording is O(buckets) without any allocation, so it can
+// be done from the detection task while another task prints the report.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+class LatencyHistogram {
+public:
+    static const size_t BUCKETS = 10;
+
+    void record(uint32_t us)
+    {
+        size_t i = 0;
+        while (i < BUCKETS - 1 && us >= bounds()[i]) {
+            ++i;
+        }
+        counts_[i]++;
+
+        if (count_ == 0 || us < min_) min_ = us;
+        if (us > max_) max_ = us;
+        sum_ += us;
+        count_++;
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    uint32_t count() const { return count_; }
+
+    // Print a one line summary followed by the non-empty buckets, returns the number of characters written
+    size_t print(char* out, size_t len, const char* name) const
+    {
+        size_t n = snprintf(out, len, "%s: n=%lu min=%lu avg=%lu max=%lu us\n", name,
+                            (unsigned long)count_, (unsigned long)min_,
+                            (unsigned long)(count_ ? sum_ / count_ : 0), (unsigned long)max_);
+
+        for (size_t i = 0; i < BUCKETS && n < len; ++i) {
+            if (!counts_[i]) {
+                continue;
+            }
+
+            if (i < BUCKETS - 1) {
+                n += snprintf(out + n, len - n, "\t< %6lu us: %lu\n",
+                              (unsigned long)bounds()[i], (unsigned long)counts_[i]);
+            } else {
+                n += snprintf(out + n, len - n, "\t>= %5lu us: %lu\n",
+                              (unsigned long)bounds()[BUCKETS - 2], (unsigned long)counts_[i]);
+            }
+        }
+
+        return n < len ? n : len - 1;
+    }
+
+private:
+    // Upper bounds of all but the last (overflow) bucket
+    static const uint32_t* bounds()
+    {
+        static const uint32_t b[BUCKETS - 1] = {
+            500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000
+        };
+        return b;
+    }
+
+    uint32_t counts_[BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t min_   = 0;
+    uint32_t max_   = 0;
+    uint64_t sum_   = 0;
+};
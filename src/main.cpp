@@ -38,11 +38,20 @@
 /*
  * HTTP Endpoints:
  * - /config                (GET)   Enter configuration mode, allowing sample uploads and OTA updates. Disables sound playback.
- * - /<sample_number>       (POST)  Upload a sample file (WAV, 8-bit Unsigned PCM, 16kHz, max 5s). Requires CONFIG mode!
- * - /reset                 (GET)   Reset samples to factory defaults
+ * - /<sample_number>       (POST)  Upload a sample file (WAV, 8-bit Unsigned PCM, mono, 8-48kHz, max MAX_DURATION seconds). Requires CONFIG mode!
+ *                                  Samples not recorded at SAMPLE_RATE are converted once after the upload.
+ *                                  Append ?adpcm to store it as 4-bit IMA-ADPCM, which halves its size.
+ *                                  Uploading to the next free number adds a slot. Append ?weight=<n> to set how likely the
+ *                                  slot is picked relative to the others (0 to MAX_SAMPLE_WEIGHT, default NEW_SAMPLE_WEIGHT
+ *                                  for new slots). Append ?gain=<percent> to set its volume (0 to MAX_SAMPLE_GAIN, default 100).
+ * - /samples               (GET)   List the sample slots of the manifest with their weights and durations.
+ * - /reset                 (GET)   Reset samples to factory defaults, removes the slots added by uploads. Requires CONFIG mode!
  * - /play<sample_number>   (GET)   Play a sample by number for debugging. Will sound worse due to WiFi interference.
  * - /measure               (GET)   Enter measurement mode, allowing sensor values to be polled via UDP. Used for debugging and calibration.
  * - /restart               (GET)   Restart the device, useful for exiting CONFIG mode.
+ * - /latency               (GET)   Report coin-to-sound latency histograms (also available as serial command "latency").
+ * - /stats                 (GET)   Report detector and sampler statistics (e.g. CPU cycles per sample), how long the boot phases took and the last upload's throughput.
+ * - /tasks                 (GET)   Report core, priority, free stack and load of the firmware tasks.
  */
 
 /* Example to upload a sample:
@@ -50,6 +59,10 @@
  *      curl -X GET http://<STATIC_IP>/config
  *  2. Upload a sample (lower sample number has higher probability):
  *      curl -X POST -F "file=@/path/to/sample.wav" http://<STATIC_IP>/<sample_number>
+ *     or, to store it compressed:
+ *      curl -X POST -F "file=@/path/to/sample.wav" "http://<STATIC_IP>/<sample_number>?adpcm"
+ *     or, to play it at 50% volume (gain in percent, 0 to MAX_SAMPLE_GAIN):
+ *      curl -X POST -F "file=@/path/to/sample.wav" "http://<STATIC_IP>/<sample_number>?gain=50"
  *  3. Play the sample to test it (note that this will sound choppy due to WiFi interference):
  *      curl -X GET http://<STATIC_IP>/play<sample_number>
  *  4. Exit CONFIG mode by restarting the device:
@@ -72,22 +85,29 @@
 #include <Arduino.h>
 #include <ArduinoOTA.h>
 #include <LittleFS.h>
-#include <XT_DAC_Audio.h>
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
 #include <ESPmDNS.h>
 
-#include <sounds.h>
-
+#include "audio.h"
+#include "audio_stream.h"
+#include "backoff.h"
 #include "config.h"
+#include "detector.h"
+#include "latency.h"
+#include "log.h"
+#include "manifest.h"
+#include "sample_store.h"
+#include "sampler.h"
+#include "samples.h"
 
 /////////////////////////////////////////////////////////////////////////////////
 // Logging Globals
 /////////////////////////////////////////////////////////////////////////////////
 
 std::vector<std::string> log_entries; // Stores recent log lines
-std::vector<uint16_t> adc_values;     // Stores recent ADC values for debugging
-std::vector<uint16_t> avg_adc_values; // Stores recent averaged ADC values for debugging
+static SemaphoreHandle_t log_mutex;   // Guards log_entries, log() is called from several tasks
+static size_t log_unprinted = 0;      // Number of log entries not yet printed to Serial
 
 ///////////////////////////////////////////////////////////////////////////////
 // Configuration Globals
@@ -99,25 +119,33 @@ static unsigned long config_timeout = 0; // Timestamp when config mode should ti
 // Coin Detection Globals
 ///////////////////////////////////////////////////////////////////////////////
 
-enum CoinState { BLOCKING, IDLE, SPIKE_START, SPIKE_END };
+// CPU cycle counter for detector benchmarks
+class EspClock : public Clock {
+public:
+    uint32_t cycles() override { return ESP.getCycleCount(); }
+};
 
-static float     baseline        = 0;       // running average
-static bool      baseline_init   = false;   // whether baseline has been initialized
-static uint32_t  spike_start_ms  = 0;       // timestamp when spike started
-static CoinState coin_state      = IDLE;    // current state of coin detection state machine
+static EspClock      esp_clock;
+static SamplerSource sampler_source;
+static CoinDetector  detector(esp_clock);
 
 /////////////////////////////////////////////////////////////////////////////////
-// Audio Globals
+// Latency Globals
 /////////////////////////////////////////////////////////////////////////////////
 
-XT_DAC_Audio_Class DacAudio(DAC_PIN,0);             // DAC audio output class
-std::array<uint32_t, N_SAMPLES> probabilities = {}; // Stores probabilities for each sample
+// micros() timestamps of the coin currently travelling from sensor to speaker
+struct CoinTiming {
+    uint32_t spike_us;      // Sample that started the spike
+    uint32_t detect_us;     // Detector reported the coin
+    uint32_t play_us;       // play_sample() was called
+    bool     pending;       // Waiting for the first audio buffer fill
+};
 
-std::array<File, N_SAMPLES> sample_files = {};           // Stores files for each sample
-std::array<std::vector<uint8_t>, N_SAMPLES> sample_buffers;
-std::array<std::unique_ptr<XT_Wav_Class>, N_SAMPLES> clips;
-std::array<uint32_t, N_SAMPLES> sample_duration_ms{};
-XT_Wav_Class* current_clip = nullptr;
+static CoinTiming       coin_timing     = {};
+static LatencyHistogram latency_detect;     // Spike start -> detection (averaging, SPIKE_END delay, queueing)
+static LatencyHistogram latency_play;       // Detection -> play_sample() (cooldown check, sample selection)
+static LatencyHistogram latency_fill;       // play_sample() -> first audio buffer fill
+static LatencyHistogram latency_total;      // Spike start -> first audio buffer fill
 
 /////////////////////////////////////////////////////////////////////////////////
 // Web Server and UDP Globals
@@ -142,9 +170,86 @@ enum device_mode {
     RESTART
 };
 
-device_mode mode = BOOT;
+volatile device_mode mode = BOOT;
 unsigned long boot_done_tstamp;
 
+/////////////////////////////////////////////////////////////////////////////////
+// Task Globals
+/////////////////////////////////////////////////////////////////////////////////
+
+// Measures the share of wall time a task spends doing work (i.e. not sleeping)
+struct LoadMeter {
+    uint32_t busy_us  = 0;  // Busy time accumulated in the current window
+    uint32_t window_us = 0; // Start of the current window
+
+    void add(uint32_t us) { busy_us += us; }
+
+    // Returns the load in 0.1 % units and starts a new window
+    unsigned int permille_and_reset() {
+        uint32_t now = micros();
+        uint32_t elapsed = now - window_us;
+        unsigned int permille = elapsed ? (uint64_t)busy_us * 1000 / elapsed : 0;
+        busy_us = 0;
+        window_us = now;
+        return permille;
+    }
+};
+
+static TaskHandle_t detect_task_handle = nullptr;   // Coin detection and audio task
+static LoadMeter    detect_load;                    // Load of the detection task
+static LoadMeter    loop_load;                      // Load of loop() (networking, logging, OTA)
+
+static volatile bool     wifi_off_requested = false; // Set by the detection task on the first coin
+static volatile uint32_t last_coin_activity = 0;     // millis() of the last detected coin
+static volatile bool     samples_ready      = false; // Set by load_task() once all samples are loaded
+static volatile uint32_t first_coin_ms      = 0;     // millis() of the first detected coin
+
+/////////////////////////////////////////////////////////////////////////////////
+// WiFi Globals
+/////////////////////////////////////////////////////////////////////////////////
+
+// WiFi connects in the background (see wifi_poll()), nothing waits for it
+enum wifi_conn_state {
+    WIFI_STATE_OFF,         // Disabled, e.g. after the first coin
+    WIFI_STATE_CONNECTING,  // Waiting for an IP address, at most WIFI_CONNECT_TIMEOUT
+    WIFI_STATE_CONNECTED,
+    WIFI_STATE_BACKOFF      // Waiting to retry after a failed attempt
+};
+
+static wifi_conn_state wifi_state   = WIFI_STATE_OFF;
+static uint32_t        wifi_since   = 0;                // millis() of the last change of state
+static Backoff         wifi_backoff(WIFI_RETRY_MIN, WIFI_RETRY_MAX);   // Delay before the next attempt if this one fails
+
+// Set by the WiFi event task, handled by wifi_poll()
+static volatile bool wifi_got_ip       = false;
+static volatile bool wifi_disconnected = false;
+
+/////////////////////////////////////////////////////////////////////////////////
+// Boot Profiling Globals
+/////////////////////////////////////////////////////////////////////////////////
+
+// Phases of booting, each one is timed from its start to its end. Samples
+// are loaded in parallel to the others, so phases may overlap.
+enum boot_phase {
+    PHASE_STARTUP,      // Reset to setup(), bootloader and runtime
+    PHASE_TASKS,        // Audio, stream and detection tasks
+    PHASE_LITTLEFS,     // Mounting LittleFS and the samples partition
+    PHASE_MANIFEST,
+    PHASE_SAMPLES,      // Loading the samples (load_task())
+    PHASE_WIFI,
+    PHASE_ROUTES,       // Web server and mDNS
+    PHASE_BOOT_WINDOW,  // End of setup() to NORMAL mode, at least BOOT_TIME
+    N_BOOT_PHASES
+};
+
+static const char* const boot_phase_names[N_BOOT_PHASES] = {
+    "Startup", "Tasks", "LittleFS", "Manifest", "Samples", "WiFi", "Web server", "Boot window"
+};
+
+// millis() at the start and end of each phase, every phase is only timed by a single task
+static uint32_t boot_phase_start[N_BOOT_PHASES];
+static uint32_t boot_phase_end[N_BOOT_PHASES];
+
 /////////////////////////////////////////////////////////////////////////////////
 // Logging Functions
 /////////////////////////////////////////////////////////////////////////////////
@@ -157,11 +262,6 @@ void log(const char* fmt, ...)
     vsnprintf(buffer, sizeof(buffer), fmt, args);
     va_end(args);
 
-    // Add to log lines
-    if (log_entries.size() >= LOG_ENTRIES) {
-        log_entries.erase(log_entries.begin());
-    }
-
     // Truncate if too long
     if (strlen(buffer) >= LOG_ENTRY_LEN) {
         buffer[LOG_ENTRY_LEN - 1] = '\0'; // Ensure null termination
@@ -170,136 +270,285 @@ void log(const char* fmt, ...)
     char log_entry[LOG_ENTRY_LEN + 16]; // Extra space for timestamp
     snprintf(log_entry, sizeof(log_entry), "[%lu] %s", millis(), buffer);
 
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+
+    // Add to log lines
+    if (log_entries.size() >= LOG_ENTRIES) {
+        log_entries.erase(log_entries.begin());
+    }
     log_entries.push_back(log_entry);
 
-    // Print to Serial
-    Serial.print(log_entry);
+    if (log_unprinted < log_entries.size()) {
+        log_unprinted++;
+    }
+
+    xSemaphoreGive(log_mutex);
+}
+
+// Print pending log entries to Serial
+// Called from loop() only, so slow serial output never stalls the detection task.
+void log_flush()
+{
+    static std::vector<std::string> pending;
+
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    pending.assign(log_entries.end() - log_unprinted, log_entries.end());
+    log_unprinted = 0;
+    xSemaphoreGive(log_mutex);
+
+    // Printed without holding log_mutex, Serial.print() blocks while the UART
+    // buffer is full and log() must never wait for that
+    for (const auto& entry : pending) {
+        Serial.print(entry.c_str());
+    }
+    pending.clear();
+}
+
+// Copy of the recent log lines, log() may add lines meanwhile
+std::vector<std::string> log_snapshot()
+{
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    std::vector<std::string> entries = log_entries;
+    xSemaphoreGive(log_mutex);
+
+    return entries;
 }
 
 /////////////////////////////////////////////////////////////////////////////////
-// Sample related functions
+// Boot Profiling Functions
 /////////////////////////////////////////////////////////////////////////////////
 
-// Initialize probabilities for sample selection based on PROBABILITY_MAIN_SAMPLE
-void init_prob()
+void phase_begin(boot_phase phase)
 {
-    constexpr unsigned P = PROBABILITY_MAIN_SAMPLE;
-    constexpr unsigned q = 100 - P;
+    boot_phase_start[phase] = millis();
+}
 
-    unsigned remain = 100;
+void phase_end(boot_phase phase)
+{
+    boot_phase_end[phase] = millis();
+    log("Boot: %s took %lu ms (%lu to %lu ms after reset)\n", boot_phase_names[phase],
+        (unsigned long)(boot_phase_end[phase] - boot_phase_start[phase]),
+        (unsigned long)boot_phase_start[phase], (unsigned long)boot_phase_end[phase]);
+}
 
-    for (int i = 0; i < N_SAMPLES - 1; ++i) {
-        probabilities[i] = (P * remain) / 100;
-        remain          -= probabilities[i];
-    }
-    probabilities[N_SAMPLES - 1] = remain;
+/////////////////////////////////////////////////////////////////////////////////
+// WiFi Functions
+/////////////////////////////////////////////////////////////////////////////////
 
-    log("Probabilities initialised:\n");
-    for (int i = 0; i < N_SAMPLES; ++i) {
-        log("\tSample %d: %u%%\n", i, probabilities[i]);
+// Runs on the WiFi event task, only note what happened for wifi_poll()
+void wifi_event(arduino_event_id_t event, arduino_event_info_t)
+{
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+        wifi_got_ip = true;
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+        wifi_disconnected = true;
     }
 }
 
-void load_clip(int idx)
+static void wifi_set_state(wifi_conn_state state)
 {
-    // Check if sample file exists
-    if (!sample_files[idx]) {
-        log("No file for sample %d\n", idx);
-        return;
-    }
-
-    // Get size of sample
-    sample_files[idx].seek(0);
-    size_t sz = sample_files[idx].size();
-
-    // Load sample from file into buffer (RAM)
-    sample_buffers[idx].resize(sz);
-    sample_files[idx].readBytes(reinterpret_cast<char*>(sample_buffers[idx].data()), sz);
+    wifi_state = state;
+    wifi_since = millis();
+}
 
-    // Create clip from buffer
-    clips[idx] = std::unique_ptr<XT_Wav_Class>(
-                     new XT_Wav_Class(sample_buffers[idx].data()));
+static void wifi_connect()
+{
+    wifi_got_ip       = false;
+    wifi_disconnected = false;
+    WiFi.begin(SSID, PASSWORD);
+    wifi_set_state(WIFI_STATE_CONNECTING);
+}
 
-    // Calculate sample duration in milliseconds
+// Start connecting, retrying with exponential backoff until a connection is made
+void wifi_start()
+{
+    log("Connecting to WiFi...\n");
+    WiFi.mode(WIFI_STA);
+    wifi_backoff.reset();
+    wifi_connect();
+}
 
-    // WAV header is a fixed 44 bytes for PCM files.
-    const size_t payload_bytes = (sz > 44) ? sz - 44 : 0;
+void wifi_stop()
+{
+    wifi_set_state(WIFI_STATE_OFF);
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+}
 
-    // 1 byte per sample (8‑bit mono)
-    // duration = samples / sampling rate (16kHz)
-    sample_duration_ms[idx] = (payload_bytes * 1000UL) / 16000UL;
+// Advance the connection state machine, called from loop()
+void wifi_poll()
+{
+    switch (wifi_state) {
+    case WIFI_STATE_OFF:
+        break;
 
-    // Trim to MAX_DURATION (failsafe if bad payload)
-    if (sample_duration_ms[idx] > MAX_DURATION * 1000UL) {
-        sample_duration_ms[idx] = MAX_DURATION * 1000UL;
-    }
+    case WIFI_STATE_CONNECTING:
+        if (wifi_got_ip) {
+            wifi_set_state(WIFI_STATE_CONNECTED);
+            wifi_backoff.reset();
+            log("Connected to WiFi\n");
+            log(("IP Address: " + std::string(WiFi.localIP().toString().c_str()) + "\n").c_str());
 
-    log("Sample %d duration: %lu ms\n",
-        idx, (unsigned long)sample_duration_ms[idx]);
-}
+            if (!boot_phase_end[PHASE_WIFI]) {
+                phase_end(PHASE_WIFI);
+            }
 
-// Initialize/Load samples from LittleFS or create default ones if they don't exist
-void init_samples() {
-    for (int i = 0; i < N_SAMPLES; ++i) {
-        String filename = "/" + String(i) + ".wav";
-
-        // Sample exists
-        if (LittleFS.exists(filename)) {
-            sample_files[i] = LittleFS.open(filename, "r");
-            if (!sample_files[i]) {
-                log("Failed to open %s\n", filename.c_str());
-            } else {
-                log("Loaded sample %d from %s\n", i, filename.c_str());
+            // Config mode must be reachable for BOOT_TIME seconds after connecting
+            if (mode == BOOT) {
+                boot_done_tstamp = millis() + BOOT_TIME * 1000;
             }
+        } else if (wifi_disconnected || millis() - wifi_since >= WIFI_CONNECT_TIMEOUT) {
+            WiFi.disconnect();
+            wifi_set_state(WIFI_STATE_BACKOFF);
+            log("WiFi connection failed, retrying in %lu ms\n", (unsigned long)wifi_backoff.delay());
         }
+        break;
 
-        // Sample does not exist, create with default sound
-        else {
-            log("Sample %d missing\n", i);
-
-            // Load coin sound as default
-            sample_files[i] = LittleFS.open(filename, "w");
-            if (sample_files[i]) {
-                switch(i) {
-                case 1:
-                    sample_files[i].write(powerup, sizeof(powerup));
-                    break;
-                case 2:
-                    sample_files[i].write(oneup, sizeof(oneup));
-                    break;
-                default:
-                    sample_files[i].write(coin, sizeof(coin)); // Default to coin sound
-                    break;
-
-                }
-                sample_files[i].close();
-                log("Using default coin sound for sample %d\n", i);
-            } else {
-                log("FATAL: Failed to create sample %d\n", i);
-                while(true);
-            }
+    case WIFI_STATE_CONNECTED:
+        if (wifi_disconnected) {
+            log("WiFi connection lost, reconnecting...\n");
+            wifi_connect();
         }
+        break;
+
+    case WIFI_STATE_BACKOFF:
+        if (millis() - wifi_since >= wifi_backoff.delay()) {
+            wifi_backoff.grow();
+            wifi_connect();
+        }
+        break;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+// Sample related functions
+/////////////////////////////////////////////////////////////////////////////////
+
+// Loads the samples while the boot window is open, so that NORMAL mode can
+// start as soon as it closes. Uploads and /reset wait until it is done.
+// Afterwards it reads the samples played from RAM when they are picked (see
+// serve_loads()), so the detection task never waits for LittleFS.
+void load_task(void*)
+{
+    phase_begin(PHASE_SAMPLES);
+    init_samples();
+    phase_end(PHASE_SAMPLES);
+
+    samples_ready = true;
+
+    serve_loads();
+}
 
-        // Load the sample into memory
-        load_clip(i);
+// Weight given with ?weight=<n>, false if it isn't a number from 0 to MAX_SAMPLE_WEIGHT
+static bool parse_weight(AsyncWebServerRequest* request, uint32_t& weight)
+{
+    return parse_number(request->getParam("weight")->value().c_str(), MAX_SAMPLE_WEIGHT, weight);
+}
+
+// Gain given with ?gain=<percent>, e.g. 50 for half the volume. False if it
+// isn't a number from 0 to MAX_SAMPLE_GAIN.
+static bool parse_gain(AsyncWebServerRequest* request, uint16_t& gain)
+{
+    uint32_t percent;
+    if (!parse_number(request->getParam("gain")->value().c_str(), MAX_SAMPLE_GAIN, percent)) {
+        return false;
     }
+    gain = (uint16_t)(percent * AUDIO_GAIN_UNITY / 100);
+    return true;
 }
 
 // Handle file uploads for samples
+// Uploads are converted while they arrive (see SampleUpdate), only one at a
+// time, others are rejected meanwhile. The slot keeps playing its previous
+// sample until the upload is complete.
+static std::unique_ptr<SampleUpdate> upload;
+static AsyncWebServerRequest*        upload_request = nullptr;
+
+// Benchmark of the last successful upload, see /stats
+struct UploadStats {
+    uint32_t bytes   = 0;   // Size of the request
+    uint32_t ms      = 0;   // First chunk until the sample was loaded
+    uint32_t written = 0;   // Bytes written to LittleFS
+    uint32_t writes  = 0;   // Writes to LittleFS it took
+};
+
+static UploadStats last_upload;
+static uint32_t    upload_start_ms = 0;
+static uint32_t    upload_chunk_ms = 0;     // millis() of the last chunk of the running upload
+
 void handle_upload(unsigned int nsample, AsyncWebServerRequest *request,
                    String filename, size_t index, uint8_t *data, size_t len, bool final) {
 
     config_timeout = millis() + CONFIG_TIMEOUT;
 
-    if (nsample >= N_SAMPLES) {
-        log("Sample %u: Rejecting upload, invalid sample number (max %d)\n", nsample, N_SAMPLES - 1);
+    // Uploading to the next free number adds a slot
+    if (nsample > n_samples || nsample >= MAX_SAMPLES) {
+        if (index == 0) {
+            request->send(404, "text/plain", "Invalid sample number\n");
+            log("Sample %u: Rejecting upload, invalid sample number (max %u)\n", nsample, (unsigned)n_samples);
+        }
+        return;
     }
 
     // First chunk
     if (index == 0) {
+        if (!samples_ready) {
+            request->send(503, "text/plain", "Samples are still loading, try again\n");
+            log("Sample %u: Rejecting upload, samples are still loading\n", nsample);
+            return;
+        }
+
+        // A second upload would drop the one that is running, unless that one stalled
+        if (upload && upload_request != request && millis() - upload_chunk_ms < UPLOAD_STALL_MS) {
+            request->send(409, "text/plain", "Another upload is in progress, try again\n");
+            log("Sample %u: Rejecting upload, another one is in progress\n", nsample);
+            return;
+        }
+
+        uint32_t weight;
+        if (request->hasParam("weight") && !parse_weight(request, weight)) {
+            request->send(400, "text/plain", "Weight must be a number from 0 to " + String(MAX_SAMPLE_WEIGHT) + "\n");
+            log("Sample %u: Rejecting upload, invalid weight\n", nsample);
+            return;
+        }
+
+        uint16_t gain = AUDIO_GAIN_UNITY;
+        if (request->hasParam("gain") && !parse_gain(request, gain)) {
+            request->send(400, "text/plain", "Gain must be a number from 0 to " + String(MAX_SAMPLE_GAIN) + "\n");
+            log("Sample %u: Rejecting upload, invalid gain\n", nsample);
+            return;
+        }
+
+        grow_slots(nsample);
+
+        // Drops a stalled upload
+        upload.reset(new SampleUpdate(nsample, request->contentLength(), request->hasParam("adpcm"), gain));
+        upload_request = request;
+
+        request->onDisconnect([request]() {
+            if (upload_request == request) {
+                upload.reset();
+                upload_request = nullptr;
+            }
+        });
+
+        upload->feed(data, len);
+        len = 0;
+
+        // 1 byte per sample, so the size limit scales with the rate the sample was recorded at
+        const uint32_t rate = upload->rate() ? upload->rate() : SAMPLE_RATE;
+
+        if (rate < RESAMPLE_MIN_RATE || rate > RESAMPLE_MAX_RATE) {
+            upload.reset();
+            request->send(415, "text/plain", "Unsupported sample rate\n");
+            log("Sample %u: Rejected upload, unsupported sample rate %lu Hz\n", nsample, (unsigned long)rate);
+            return;
+        }
+
         size_t left = LittleFS.totalBytes() - LittleFS.usedBytes();
-        if (request->contentLength() > SAMPLE_SIZE ||
+        if (request->contentLength() > (size_t)rate * MAX_DURATION ||
                 request->contentLength() > left) {
+            upload.reset();
             const std::string error_msg = "Sample exceeds " + std::to_string(MAX_DURATION) + "s";
             request->send(507, "text/plain", error_msg.c_str());
             log("Sample %u: Rejected upload, too large (%u B)\n", nsample, request->contentLength());
@@ -308,258 +557,388 @@ void handle_upload(unsigned int nsample, AsyncWebServerRequest *request,
 
         log("Sample %u: Uploading %s (%u B)\n",
             nsample, filename.c_str(), request->contentLength());
-
-        File file = LittleFS.open("/" + String(nsample) + ".wav", "w");
-        request->_tempFile = file;
+        upload_start_ms = millis();
     }
 
-    // Write chunk
-    if (request->_tempFile) {
-        request->_tempFile.write(data, len);
+    if (!upload || upload_request != request) {
+        return;
     }
+    upload_chunk_ms = millis();
+
+    // Convert chunk
+    upload->feed(data, len);
 
     // Final chunk
-    if (final && request->_tempFile) {
-        request->_tempFile.close();
+    if (final) {
         log("Sample %u: Upload complete\n", nsample);
 
-        sample_files[nsample] = LittleFS.open("/" + String(nsample) + ".wav", "r");
-        if (!sample_files[nsample]) {
-            log("Sample %u: Failed to open uploaded file\n", nsample);
+        const bool ok        = upload->commit();
+        const bool truncated = upload->truncated();
+
+        if (ok) {
+            last_upload.bytes   = request->contentLength();
+            last_upload.ms      = millis() - upload_start_ms;
+            last_upload.written = upload->written();
+            last_upload.writes  = upload->writes();
+            log("Sample %u: %lu B in %lu ms (%lu KB/s), %lu B written in %lu writes\n", nsample,
+                (unsigned long)last_upload.bytes, (unsigned long)last_upload.ms,
+                (unsigned long)((uint64_t)last_upload.bytes * 1000 / 1024 / (last_upload.ms ? last_upload.ms : 1)),
+                (unsigned long)last_upload.written, (unsigned long)last_upload.writes);
         }
 
-        load_clip(nsample);
+        upload.reset();
+        upload_request = nullptr;
+
+        // Weight relative to the other slots, e.g. ?weight=5, checked with the first chunk
+        uint32_t   weight   = NEW_SAMPLE_WEIGHT;
+        const bool weighted = request->hasParam("weight") && parse_weight(request, weight);
+        if (ok && (nsample == n_samples || weighted)) {
+            probabilities[nsample] = weight;
+            if (nsample == n_samples) {
+                n_samples++;
+                log("Sample %u: Added to the manifest\n", nsample);
+            }
+            write_manifest();
+        }
 
-        request->send(200, "text/plain", "Sample uploaded successfully\n");
+        if (ok) {
+            request->send(200, "text/plain", "Sample uploaded successfully\n");
+        } else if (truncated) {
+            log("Sample %u: Upload incomplete, keeping the previous sample\n", nsample);
+            request->send(400, "text/plain", "Upload incomplete\n");
+        } else {
+            log("Sample %u: Conversion failed, keeping the previous sample\n", nsample);
+            request->send(415, "text/plain", "Unsupported sample format\n");
+        }
     }
 }
 
-// Reset samples to factory defaults
-void reset_samples() {
-    log("Factory reset: resetting samples to defaults...\n");
 
-    config_timeout = millis() + CONFIG_TIMEOUT;
+/////////////////////////////////////////////////////////////////////////////////
+// Coin Detection Functions
+/////////////////////////////////////////////////////////////////////////////////
 
-    for (int i = 0; i < N_SAMPLES; ++i) {
-        String fn = "/" + String(i) + ".wav";
+// Log detector state changes
+void log_detector_event(DetectorEvent event, const DetectorEventInfo& info) {
+    switch (event) {
+    case LID_OPEN_THRESHOLD:
+        log("Lid open detected (sensor exceeds threshold), blocking coin detection!\n");
+        log("Detection data:\n\tThreshold High: %d\n\tThershold Low: %d\n\tBaseline: %.2f\n\tRead: %u\n\tDiff: %d\n",
+            HIGH_THRESHOLD, LOW_THRESHOLD, info.baseline, info.read, (int)info.diff);
+        break;
+    case LID_OPEN_SPIKE:
+        log("Lid open detected (spike too long), blocking coin detection!\n");
+        break;
+    case REACTIVATED:
+        log("Coin detection reactivated\n");
+        break;
+    case COIN_DETECTED:
+        coin_timing.spike_us  = info.spike_start_us;
+        coin_timing.detect_us = micros();
+        break;
+    }
+}
 
-        if (sample_files[i]) sample_files[i].close();
-        LittleFS.remove(fn); // ensure truncate
+// Drain the sample ring and handle coin detection logic
+bool poll_coin_sensor(bool update_baseline = true) {
+    return detector.poll(sampler_source, update_baseline);
+}
 
-        File f = LittleFS.open(fn, "w");
-        if (!f) {
-            log("Failed to open %s for writing\n", fn.c_str());
-            continue;
-        }
+// Allows for remote measurement of sensor values via UDP
+// Used for debugging and calibration
+void measure_sensor() {
+    AdcSample sample;
+    uint16_t raw = 0;
+    bool have_sample = false;
+
+    // Forward every queued sample to serial, keep the latest for UDP
+    while (sampler_pop(sample)) {
+        raw = sample.raw;
+        have_sample = true;
+        Serial.println(raw);
+    }
 
-        switch(i) {
-        case 1:
-            f.write(powerup, sizeof(powerup));
-            break;
-        case 2:
-            f.write(oneup, sizeof(oneup));
-            break;
-        default:
-            f.write(coin, sizeof(coin)); // Default to coin sound
-        }
+    if (!have_sample) return;
 
-        f.close();
+    // Check for incoming UDP packets (handles keep-alive)
+    int packetSize = udp.parsePacket();
+    if (packetSize) {
+        remote_ip = udp.remoteIP();
+        remote_port = udp.remotePort();
+        client = true;
 
-        // Re-open read-only to use during playback
-        sample_files[i] = LittleFS.open(fn, "r");
-        if (!sample_files[i]) {
-            log("Failed to reopen %s\n", fn.c_str());
-        }
+        // Read and discard any data (we just care about the connection)
+        char temp[64];
+        udp.read(temp, sizeof(temp));
+    }
 
-        // Load the sample into memory
-        load_clip(i);
+    // Send data if we have an active client
+    if (client) {
+        uint32_t now = millis();
+        if (now - last_udp_send >= UDP_SEND_INTERVAL) {
+            char buffer[20];
+            snprintf(buffer, sizeof(buffer), "%u\n", raw);
+            udp.beginPacket(remote_ip, remote_port);
+            udp.write((uint8_t*)buffer, strlen(buffer));
+            udp.endPacket();
+            last_udp_send = now;
+        }
     }
 }
 
-// Play a sample by index
-void play_sample(int idx)
-{
-    if (clips[idx]) {
-        current_clip = clips[idx].get();
-        DacAudio.Play(current_clip);
+/////////////////////////////////////////////////////////////////////////////////
+// Detection Task
+/////////////////////////////////////////////////////////////////////////////////
+
+// Poll the coin sensor and play a sound for each detected coin
+// Coins closer than COOLDOWN to the previous one are ignored, all others get
+// their own voice, so their sounds overlap.
+void handle_coins() {
+    static unsigned long  last_coin_tstamp = 0;     // Last time a coin was detected
+    static unsigned long  playing_until = 0;        // When the last sound playback ends
+
+    bool playing = (millis() < playing_until);
+    if (!poll_coin_sensor(!playing)) {
+        return;
     }
-}
 
-// Pick a random sample based on probabilities
-unsigned int pick_sample() {
-    if (probabilities[0] == 0) {
-        log("Probabilities not initialized!\n");
-        init_prob();
+    last_coin_activity = millis();
+
+    if (millis() - last_coin_tstamp < COOLDOWN) {
+        return; // Ignore if coin detected too soon
     }
 
-    unsigned int r = random(100);
-    unsigned int cumulative = 0;
-    for (unsigned int i = 0; i < N_SAMPLES; ++i) {
-        cumulative += probabilities[i];
-        if (r < cumulative) {
-            log("Playing sample %u\n", i);
-            return i;
-        }
+    last_coin_tstamp = millis();
+    if (!first_coin_ms) {
+        first_coin_ms = last_coin_tstamp;
     }
 
-    // Should not happen, but just in case
-    log("WARNING: Failed to pick sample, falling back to first sample\n");
-    return 0;
-}
+    unsigned int pick = pick_sample();
 
-/////////////////////////////////////////////////////////////////////////////////
-// Coin Detection Functions
-/////////////////////////////////////////////////////////////////////////////////
+    // Shouldn't happen, but just to be sure
+    if (pick >= n_samples) {
+        pick = 0; // Fallback to first sample if out of range
+        log("WARNING: Sample index out of range, falling back to sample 0\n");
+    }
+
+    // Keep the baseline frozen until every overlapping sound has ended
+    const unsigned long until = millis() + sample_duration_ms[pick];
+    if (until > playing_until) {
+        playing_until = until;
+    }
 
-unsigned int take_samples = ADC_SAMPLES; // Number of samples to take for baseline
+    // WiFi interferes with audio playback, loop() disables it after the first coin
+    wifi_off_requested = true;
 
-// Poll the coin sensor and handle coin detection logic
-bool poll_coin_sensor(bool update_baseline = true) {
-    static uint32_t last_sample_us = 0;
-    static unsigned long block_until = 0;
-    static unsigned int read = 0;
-    static uint16_t last_read = analogRead(SENSOR_PIN);
-    static int16_t max_updiff = -1;
+    coin_timing.play_us = micros();
+    play_sample(pick);
+    coin_timing.pending = true;
+}
 
-    bool coin_hit = false;
+// Record coin-to-sound latency once the first audio buffer containing the coin's sound was filled
+void record_latency() {
+    uint32_t fill_us;
 
-    uint32_t now_us = micros();
-    if (now_us - last_sample_us < SAMPLE_PERIOD_US) {
-        return false;
+    if (!coin_timing.pending || !audio_clip_started(fill_us)) {
+        return;
     }
-    last_sample_us = now_us;
 
-    if (take_samples > 0) {
-        if (take_samples == ADC_SAMPLES) {
-            read = 0;
-        }
-        uint16_t raw = analogRead(SENSOR_PIN);
+    latency_detect.record(coin_timing.detect_us - coin_timing.spike_us);
+    latency_play.record(coin_timing.play_us - coin_timing.detect_us);
+    latency_fill.record(fill_us - coin_timing.play_us);
+    latency_total.record(fill_us - coin_timing.spike_us);
 
-        if (adc_values.size() >= LOG_ADC_VALUES) {
-            adc_values.erase(adc_values.begin());
-        }
-        adc_values.push_back(raw);
+    coin_timing.pending = false;
+}
 
-        read += raw;
-        take_samples--;
-        return false;
-    } else {
-        read /= ADC_SAMPLES;
+// Coin detection, pinned to DETECT_TASK_CORE.
+// Networking, logging and HTTP handlers run on the other core, so WiFi
+// and AsyncTCP can't delay detection. Audio is streamed by its own task.
+void detect_task(void*) {
+    for (;;) {
+        uint32_t start = micros();
 
-        if (avg_adc_values.size() >= LOG_ADC_AVG_VALUES) {
-            avg_adc_values.erase(avg_adc_values.begin());
+        if (mode == NORMAL) {
+            handle_coins();
         }
-        avg_adc_values.push_back(read);
 
-        take_samples = ADC_SAMPLES;
-    }
+        record_latency();
 
-    if (!baseline_init) {
-        baseline = read;
-        baseline_init = true;
+        detect_load.add(micros() - start);
+        vTaskDelay(1);
     }
+}
 
-    int16_t diff = (int16_t)read - (int16_t)baseline;
+// Append one line of task statistics to a report
+static void report_task(String& out, const char* name, TaskHandle_t handle, int load_permille = -1) {
+    char line[96];
 
-    switch (coin_state) {
-    case BLOCKING:
-        if (baseline < LOW_THRESHOLD || baseline > HIGH_THRESHOLD ||
-                read < LOW_THRESHOLD || read > HIGH_THRESHOLD) {
-            block_until = millis() + BLOCK_AFTER_LID_OPEN;
-        }
-        else if (millis() >= block_until) {
-            coin_state = IDLE;
-            log("Coin detection reactivated\n");
-        }
-        break;
-    case IDLE:
-        // If we're outside the thresholds, the lid is likely open
-        if (baseline < LOW_THRESHOLD || baseline > HIGH_THRESHOLD ||
-                read < LOW_THRESHOLD || read > HIGH_THRESHOLD) {
-            log("Lid open detected (sensor exceeds threshold), blocking coin detection!\n");
-            log("Detection data:\n\tThreshold High: %d\n\tThershold Low: %d\n\tBaseline: %.2f\n\tRead: %u\n\tDiff: %d\n",
-                HIGH_THRESHOLD, LOW_THRESHOLD, baseline, read, (int)diff);
-            coin_state = BLOCKING;
-            block_until = millis() + BLOCK_AFTER_LID_OPEN;
-            break;
-        }
-
-        // If the difference is above the threshold, start a spike
-        if (diff < -SPIKE_THRESHOLD) {
-            coin_state     = SPIKE_START;
-            spike_start_ms = millis();
+    if (!handle) {
+        snprintf(line, sizeof(line), "%-12s not running\n", name);
+    } else {
+        BaseType_t core = xTaskGetAffinity(handle);
+        char load[16] = "-";
+        if (load_permille >= 0) {
+            snprintf(load, sizeof(load), "%d.%d%%", load_permille / 10, load_permille % 10);
         }
-        break;
+        snprintf(line, sizeof(line), "%-12s %-5s %-5u %-12u %s\n", name,
+                 core == tskNO_AFFINITY ? "any" : String(core).c_str(),
+                 (unsigned)uxTaskPriorityGet(handle),
+                 (unsigned)uxTaskGetStackHighWaterMark(handle), load);
+    }
 
-    case SPIKE_START: {
-        // Spike within time threshold
-        int16_t updiff = (int16_t)read - (int16_t)last_read;
+    out += line;
+}
 
-        if (updiff > max_updiff) {
-            max_updiff = updiff;
-        }
+// Report core, priority, minimum free stack (bytes) and load of the relevant tasks
+// Load is measured since the previous report for our own tasks.
+String task_report() {
+    String out = "Task         Core  Prio  Stack free   Load\n";
+
+    report_task(out, "detect", detect_task_handle, detect_load.permille_and_reset());
+    report_task(out, "audio", xTaskGetHandle("audio"));
+    report_task(out, "loopTask", xTaskGetHandle("loopTask"), loop_load.permille_and_reset());
+    report_task(out, "async_tcp", xTaskGetHandle("async_tcp"));
+    report_task(out, "esp_timer", xTaskGetHandle("esp_timer"));
+    report_task(out, "wifi", xTaskGetHandle("wifi"));
+    report_task(out, "tiT", xTaskGetHandle("tiT"));
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    // Run time stats are available, add the CPU share of every task since boot
+    static char stats[1024];
+    vTaskGetRunTimeStats(stats);
+    out += "\nRun time since boot:\n";
+    out += stats;
+#endif
+
+    return out;
+}
+
+// Report firmware statistics for benchmarking
+String stats_report() {
+    char buf[160];
+    String out;
+
+#ifdef DETECTOR_FLOAT_REFERENCE
+    const char* arith = "float";
+#else
+    const char* arith = "fixed";
+#endif
 
-        if (updiff > SPIKE_THRESHOLD) {
-            coin_state = SPIKE_END;
+    snprintf(buf, sizeof(buf), "Detector (%s): %lu samples, %lu cycles/sample avg, %lu max\n", arith,
+             (unsigned long)detector.runs(),
+             (unsigned long)detector.cycles_avg(),
+             (unsigned long)detector.cycles_max());
+    out += buf;
+
+    snprintf(buf, sizeof(buf), "Noise: %.2f, spike threshold %u\n",
+             detector.noise(), (unsigned)detector.spike_threshold());
+    out += buf;
+
+    snprintf(buf, sizeof(buf), "Sampler: %lu overruns\n", (unsigned long)sampler_overruns());
+    out += buf;
+
+    // Converting a buffer of PCM from mapped flash vs. RAM shows the cost of flash cache misses,
+    // ADPCM vs. PCM the cost of decoding
+    for (int adpcm = 0; adpcm <= 1; ++adpcm) {
+        for (int flash = 0; flash <= 1; ++flash) {
+            const AudioFillStats fill = audio_fill_stats(flash, adpcm);
+            snprintf(buf, sizeof(buf), "Audio fill (%s%s): %lu buffers, %lu cycles/buffer avg, %lu max\n",
+                     flash ? "flash" : "RAM", adpcm ? ", ADPCM" : "", (unsigned long)fill.buffers,
+                     (unsigned long)fill.cycles_avg, (unsigned long)fill.cycles_max);
+            out += buf;
         }
-        // Discard spikes that last too long
-        else if (millis() - spike_start_ms > SPIKE_MAX_MS) {
-            log("Lid open detected (spike too long), blocking coin detection!\n");
-            coin_state = BLOCKING;
-            block_until = millis() + BLOCK_AFTER_LID_OPEN;
+    }
+
+    snprintf(buf, sizeof(buf), "Audio voices: %d of %d playing, %lu cut off\n",
+             audio_voices(), AUDIO_VOICES, (unsigned long)audio_steals());
+    out += buf;
+
+    snprintf(buf, sizeof(buf), "Sample cache: %u of %u B, %lu hits, %lu misses, %lu dropped\n",
+             (unsigned)sample_cache.bytes(), (unsigned)sample_cache.budget(), (unsigned long)sample_cache.hits(),
+             (unsigned long)sample_cache.misses(), (unsigned long)sample_cache.evictions());
+    out += buf;
+
+    for (int p = 0; p < N_BOOT_PHASES; ++p) {
+        if (boot_phase_end[p]) {
+            snprintf(buf, sizeof(buf), "Boot %s: %lu ms (%lu to %lu ms after reset)\n", boot_phase_names[p],
+                     (unsigned long)(boot_phase_end[p] - boot_phase_start[p]),
+                     (unsigned long)boot_phase_start[p], (unsigned long)boot_phase_end[p]);
+            out += buf;
         }
-        break;
     }
-    case SPIKE_END:
-        coin_hit = true;
-        coin_state = IDLE;
-        break;
+
+    if (first_coin_ms) {
+        snprintf(buf, sizeof(buf), "First coin: %lu ms after reset\n", (unsigned long)first_coin_ms);
+        out += buf;
     }
 
-    if ((coin_state == IDLE || coin_state == BLOCKING) && update_baseline) {
-        baseline += BASELINE_ALPHA * ((float)read - baseline);
+    if (last_upload.bytes) {
+        snprintf(buf, sizeof(buf), "Last upload: %lu B in %lu ms (%lu KB/s), %lu B written in %lu writes\n",
+                 (unsigned long)last_upload.bytes, (unsigned long)last_upload.ms,
+                 (unsigned long)((uint64_t)last_upload.bytes * 1000 / 1024 / (last_upload.ms ? last_upload.ms : 1)),
+                 (unsigned long)last_upload.written, (unsigned long)last_upload.writes);
+        out += buf;
     }
 
-    last_read = read;
+    for (size_t i = 0; i < n_samples; ++i) {
+        if (sample_streams[i].is_open()) {
+            snprintf(buf, sizeof(buf), "Stream %u: read-ahead %u B (min %u B), %lu underruns\n", (unsigned)i,
+                     (unsigned)sample_streams[i].read_ahead(), (unsigned)sample_streams[i].min_read_ahead(),
+                     (unsigned long)sample_streams[i].underruns());
+            out += buf;
+        }
+    }
 
-    return coin_hit;
+    return out;
 }
 
-// Allows for remote measurement of sensor values via UDP
-// Used for debugging and calibration
-void measure_sensor() {
-    static uint32_t last_sample_us = 0;
-    uint32_t now_us = micros();
-
-    // Sample at 500Hz (every 2000µs)
-    if (now_us - last_sample_us < SAMPLE_PERIOD_US) return;
-    last_sample_us = now_us;
+// Report coin-to-sound latency histograms
+String latency_report() {
+    static char buf[512];
+    String out;
+
+    latency_detect.print(buf, sizeof(buf), "Spike start -> detection");
+    out += buf;
+    latency_play.print(buf, sizeof(buf), "Detection -> play_sample()");
+    out += buf;
+    latency_fill.print(buf, sizeof(buf), "play_sample() -> first buffer fill");
+    out += buf;
+    latency_total.print(buf, sizeof(buf), "Total (spike start -> first buffer fill)");
+    out += buf;
+
+    return out;
+}
 
-    uint16_t raw = analogRead(SENSOR_PIN);
-    Serial.println(raw);
+// Handle debug commands typed into the serial monitor
+void handle_serial() {
+    static char line[32];
+    static size_t len = 0;
 
-    // Check for incoming UDP packets (handles keep-alive)
-    int packetSize = udp.parsePacket();
-    if (packetSize) {
-        remote_ip = udp.remoteIP();
-        remote_port = udp.remotePort();
-        client = true;
+    while (Serial.available()) {
+        char c = Serial.read();
 
-        // Read and discard any data (we just care about the connection)
-        char temp[64];
-        udp.read(temp, sizeof(temp));
-    }
+        if (c != '\n' && c != '\r') {
+            if (len < sizeof(line) - 1) {
+                line[len++] = c;
+            }
+            continue;
+        }
 
-    // Send data if we have an active client
-    if (client) {
-        uint32_t now = millis();
-        if (now - last_udp_send >= UDP_SEND_INTERVAL) {
-            char buffer[20];
-            snprintf(buffer, sizeof(buffer), "%u\n", raw);
-            udp.beginPacket(remote_ip, remote_port);
-            udp.write((uint8_t*)buffer, strlen(buffer));
-            udp.endPacket();
-            last_udp_send = now;
+        if (len == 0) {
+            continue;
+        }
+        line[len] = '\0';
+        len = 0;
+
+        if (!strcmp(line, "latency")) {
+            Serial.print(latency_report());
+        } else if (!strcmp(line, "stats")) {
+            Serial.print(stats_report());
+        } else if (!strcmp(line, "tasks")) {
+            Serial.print(task_report());
+        } else {
+            Serial.print("Unknown command, try: latency, stats, tasks\n");
         }
     }
 }
@@ -588,40 +967,88 @@ void expose_mDNS() {
     }
 }
 
-// Initialize web server routes for sample uploads and playback
-void init_routes() {
-    for (int i = 0; i < N_SAMPLES; ++i)
+// Parse the sample number at the end of url, after prefix
+static bool parse_sample_url(const String& url, const char* prefix, unsigned& nsample)
+{
+    const size_t n = strlen(prefix);
+    if (!url.startsWith(prefix) || url.length() == n || url.length() > n + 3) {
+        return false;
+    }
+
+    for (unsigned i = n; i < url.length(); ++i) {
+        if (url[i] < '0' || url[i] > '9') {
+            return false;
+        }
+    }
+
+    nsample = url.substring(n).toInt();
+    return true;
+}
+
+// Serves /<sample_number> (upload) and /play<sample_number> for all slots,
+// so the number of slots doesn't cost a route registration each
+class SampleHandler : public AsyncWebHandler {
+public:
+    bool canHandle(AsyncWebServerRequest *request) const override
     {
-        const int sample = i;
-
-        server.on(("/" + String(sample)).c_str(), HTTP_POST,
-                  [](AsyncWebServerRequest *request)
-        {
-        },
-        [sample](AsyncWebServerRequest *request,
-                 String filename, size_t index,
-                 uint8_t *data, size_t len, bool final)
-        {
-            if (mode != CONFIG) {
-                request->send(403, "text/plain", "Forbidden: Not in config mode\n");
-                return;
-            }
-            handle_upload(sample, request,
-                          filename, index, data, len, final);
-        });
+        unsigned nsample;
+        return (request->method() == HTTP_POST && parse_sample_url(request->url(), "/", nsample)) ||
+               (request->method() == HTTP_GET && parse_sample_url(request->url(), "/play", nsample));
+    }
 
-        server.on(("/play" + String(sample)).c_str(), HTTP_GET,
-                  [sample](AsyncWebServerRequest *request)
-        {
-            if (sample_files[sample]) {
-                play_sample(sample);
-                request->send(200, "text/plain", "Playing sample " + String(sample) + "\n");
-            } else {
-                request->send(404, "text/plain", "Sample not found\n");
-            }
-        });
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        unsigned nsample;
+
+        // Uploads are answered by handle_upload() once complete
+        if (!parse_sample_url(request->url(), "/play", nsample)) {
+            return;
+        }
+
+        // Built-in sounds have no file, samples played from RAM may not be loaded yet
+        if (nsample < n_samples && (clips[nsample].len || sample_cache[nsample].len)) {
+            play_sample(nsample);
+            request->send(200, "text/plain", "Playing sample " + String(nsample) + "\n");
+        } else {
+            request->send(404, "text/plain", "Sample not found\n");
+        }
+    }
+
+    void handleUpload(AsyncWebServerRequest *request, const String& filename, size_t index,
+                      uint8_t *data, size_t len, bool final) override
+    {
+        unsigned nsample;
+        if (!parse_sample_url(request->url(), "/", nsample)) {
+            return;
+        }
+
+        if (mode != CONFIG) {
+            request->send(403, "text/plain", "Forbidden: Not in config mode\n");
+            return;
+        }
+        handle_upload(nsample, request,
+                      filename, index, data, len, final);
     }
 
+    bool isRequestHandlerTrivial() const override { return false; }
+};
+
+static SampleHandler sample_handler;
+
+// Initialize web server routes for sample uploads and playback
+void init_routes() {
+    server.addHandler(&sample_handler);
+
+    server.on("/samples", HTTP_GET, [](AsyncWebServerRequest *request) {
+        String response;
+        for (size_t i = 0; i < n_samples; ++i) {
+            response += String((unsigned long)i) + ": weight " + String((unsigned long)probabilities[i]) +
+                        ", " + String((unsigned long)sample_duration_ms[i]) + " ms" +
+                        (clips[i].adpcm ? ", ADPCM" : "") + (sample_files[i] ? "\n" : ", built-in\n");
+        }
+        request->send(200, "text/plain", response);
+    });
+
     server.on("/ping", HTTP_GET, [](AsyncWebServerRequest *request) {
         request->send(200, "text/plain", "pong\n");
     });
@@ -636,14 +1063,23 @@ void init_routes() {
 
     // Returns CSV with recent ADC values for debugging
     server.on("/dump", HTTP_GET, [](AsyncWebServerRequest *request) {
+        // Snapshots are consistent even while the detection task keeps pushing
+        std::vector<uint16_t> values;
+
         String response = "ADC Values:\n";
-        for (const auto& value : adc_values) {
+        detector.raw_history.snapshot(values);
+        for (const auto& value : values) {
             response += String(value) + ",";
         }
         response += "\nAveraged ADC Values:\n";
-        for (const auto& value : avg_adc_values) {
+        detector.avg_history.snapshot(values);
+        for (const auto& value : values) {
             response += String(value) + ",";
         }
+        response += "\nDetector:\n";
+        response += "Baseline: " + String(detector.baseline(), 2) + "\n";
+        response += "Noise: " + String(detector.noise(), 2) + "\n";
+        response += "Spike threshold: " + String(detector.spike_threshold()) + "\n";
         request->send(200, "text/plain", response);
         log("Dumped ADC values to client\n");
     });
@@ -666,15 +1102,37 @@ void init_routes() {
         mode = RESTART; // Signal to restart
     });
 
+    // Only in CONFIG mode, where the detection task doesn't pick samples while the slots change
     server.on("/reset", HTTP_GET, [](AsyncWebServerRequest *request) {
+        if (mode != CONFIG) {
+            request->send(403, "text/plain", "Forbidden: Not in config mode\n");
+            return;
+        }
+        if (!samples_ready) {
+            request->send(503, "text/plain", "Samples are still loading, try again\n");
+            return;
+        }
         log("Resetting samples to factory defaults...\n");
         request->send(200, "text/plain", "Resetting samples...\n");
+        config_timeout = millis() + CONFIG_TIMEOUT;
         reset_samples();
     });
 
+    server.on("/latency", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", latency_report());
+    });
+
+    server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", stats_report());
+    });
+
+    server.on("/tasks", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", task_report());
+    });
+
     server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request) {
         String response;
-        for (const auto& entry : log_entries) {
+        for (const auto& entry : log_snapshot()) {
             response += String(entry.c_str());
         }
         request->send(200, "text/plain", response);
@@ -686,56 +1144,87 @@ void init_routes() {
 /////////////////////////////////////////////////////////////////////////////////
 
 void setup() {
+    log_mutex = xSemaphoreCreateMutex();
+    samples_begin();
+
+    phase_end(PHASE_STARTUP);
+    phase_begin(PHASE_TASKS);
+
     Serial.begin(115200);
 
     pinMode(SENSOR_PIN, INPUT);
     analogReadResolution(12);
     analogSetAttenuation(ADC_11db);
 
-    probabilities.fill(0); // Will be initialized later
-
-    IPAddress gateway(192, 168, 0, 1);
-    IPAddress subnet(255, 255, 255, 0);
+    detector.on_event(log_detector_event);
 
-    if (!WiFi.config(IPAddress(STATIC_IP), gateway, subnet)) {
-        log("Failed to configure static IP\n");
-    }
+    audio_begin();
+    stream_begin();
 
-    WiFi.begin(SSID, PASSWORD);
-    unsigned long tout_start = millis();
-    bool fail = false;
+    // Detection and audio get their own core, loop() shares the other one with WiFi
+    xTaskCreatePinnedToCore(detect_task, "detect", DETECT_TASK_STACK, nullptr,
+                            DETECT_TASK_PRIORITY, &detect_task_handle, DETECT_TASK_CORE);
 
-    log("Connecting to WiFi...\n");
+    phase_end(PHASE_TASKS);
+    phase_begin(PHASE_LITTLEFS);
 
-    while (WiFi.status() != WL_CONNECTED) {
-        if (millis() - tout_start >= WIFI_CONNECT_TIMEOUT) {
-            fail = true;
-            return;
-        }
+    if (!LittleFS.begin(true)) {
+        log("FATAL: LittleFS mount failed\n");
+        while(true);
     }
 
-    if (fail) {
-        log("WiFi connection timeout, continuing without connection...\n");
-    } else {
-        log("Connected to WiFi\n");
-        log(("IP Address: " + std::string(WiFi.localIP().toString().c_str()) + "\n").c_str());
+    if (!store_begin()) {
+        log("No \"%s\" partition, samples will be kept in RAM\n", SAMPLE_PARTITION);
     }
 
-    if (!LittleFS.begin(true)) {
-        log("FATAL: LittleFS mount failed\n");
-        while(true);
+    phase_end(PHASE_LITTLEFS);
+    phase_begin(PHASE_MANIFEST);
+    init_manifest();
+    phase_end(PHASE_MANIFEST);
+
+    // Samples are loaded in the background while WiFi connects and the boot window is open
+    xTaskCreatePinnedToCore(load_task, "load", LOAD_TASK_STACK, nullptr,
+                            LOAD_TASK_PRIORITY, nullptr, LOAD_TASK_CORE);
+
+    // WiFi connects in the background, it ends with the first connection (see wifi_poll())
+    phase_begin(PHASE_WIFI);
+
+    IPAddress gateway(192, 168, 0, 1);
+    IPAddress subnet(255, 255, 255, 0);
+
+    // Reconnecting is up to wifi_poll(), with backoff
+    WiFi.onEvent(wifi_event);
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+
+    if (!WiFi.config(IPAddress(STATIC_IP), gateway, subnet)) {
+        log("Failed to configure static IP\n");
     }
 
+    wifi_start();
+
+    phase_begin(PHASE_ROUTES);
+
     init_routes();
-    init_prob();
     server.begin();
     expose_mDNS();
 
-    boot_done_tstamp = millis() + BOOT_TIME * 1000;
-    log(("Entering boot mode, ignoring sensor input for " + std::to_string(BOOT_TIME) + " seconds\n").c_str());
+    phase_end(PHASE_ROUTES);
+    phase_begin(PHASE_BOOT_WINDOW);
+
+    // Extended to BOOT_TIME seconds after connecting if WiFi connects in time,
+    // otherwise the box starts detecting coins without waiting any longer
+    boot_done_tstamp = millis() + WIFI_CONNECT_TIMEOUT;
+    log(("Entering boot mode, ignoring sensor input for " + std::to_string(BOOT_TIME) + " seconds once WiFi is connected\n").c_str());
 }
 
 void loop() {
+    uint32_t start = micros();
+
+    log_flush();
+    handle_serial();
+    wifi_poll();
+
     switch(mode) {
 
     /* Boot Mode:
@@ -743,12 +1232,16 @@ void loop() {
      * during which the device can be put into config mode.
      * This is a failsafe that prevents the device from immediately switching to normal mode after
      * boot, which could happen due to unexpected sensor behavior or misconfigured detection parameters.
+     * The samples are loaded by load_task() meanwhile, the window only gets longer if that takes more time.
+     * Without a WiFi connection within WIFI_CONNECT_TIMEOUT, the box runs offline until it connects.
      */
     case BOOT: {
-        if (millis() >= boot_done_tstamp) {
+        if (millis() >= boot_done_tstamp && samples_ready) {
+            sampler_begin();
             mode = NORMAL;
-            init_samples();
-            log("Ready to detect coins!\n");
+            phase_end(PHASE_BOOT_WINDOW);
+            log("Ready to detect coins, %lu ms after reset%s\n", millis(),
+                (wifi_state == WIFI_STATE_CONNECTED) ? "" : " (WiFi not connected)");
         }
         break;
     }
@@ -759,8 +1252,8 @@ void loop() {
      * Used for debugging and calibration.
      */
     case MEASURE: {
+        sampler_begin();
         measure_sensor();
-        DacAudio.FillBuffer();
         break;
     }
 
@@ -772,6 +1265,8 @@ void loop() {
      * e.g., by sending a GET request to /restart.
      */
     case CONFIG: {
+        sampler_end(); // No coin detection in config mode
+
         if (millis() >= config_timeout) {
             log("Config mode timed out, restarting...\n");
             ArduinoOTA.end();
@@ -781,70 +1276,41 @@ void loop() {
         }
 
         ArduinoOTA.handle();
-        DacAudio.FillBuffer();
         break;
     }
 
     /* Normal Mode:
      * Normal operation mode, where the device waits for the first coin.
-     * After the first coin is detected, it switches to normal mode.
-     * In this mode, the device handles coin detection and plays sounds.
-     * If a sound is already playing, it waits for COOLDOWN before processing new coins.
+     * Coin detection and sound playback run in detect_task() on the other core,
+     * loop() only takes care of WiFi: it is disabled after the first coin and,
+     * if configured, reactivated after REACTIVATE_WIFI_AFTER ms without coins.
      */
     case NORMAL: {
-        static unsigned long  last_coin_tstamp = 0;     // Last time a coin was detected
-        static unsigned long  playing_until = 0;        // When the current sound playback ends
-        static bool           wifi_active     = true;   // Whether WiFi is active
-        static unsigned long  reactive_wifi_at = 0;     // When to reactivate WiFi after disabling it
-
-        // Poll the coin sensor
-        bool playing = (millis() < playing_until);
-        if (poll_coin_sensor(!playing)) {
-
-            reactive_wifi_at = millis() + REACTIVATE_WIFI_AFTER;
+        if (wifi_off_requested) {
+            static bool first_coin = true;
 
-            if (millis() - last_coin_tstamp < COOLDOWN) {
-                return; // Ignore if coin detected too soon
+            wifi_off_requested = false;
+            if (first_coin) {
+                first_coin = false;
+                log("First coin detected %lu ms after reset\n", (unsigned long)first_coin_ms);
             }
 
-            last_coin_tstamp = millis();
-
-            unsigned int pick = pick_sample();
-
-            // Shouldn't happen, but just to be sure
-            if (pick >= N_SAMPLES) {
-                pick = 0; // Fallback to first sample if out of range
-                log("WARNING: Sample index out of range, falling back to sample 0\n");
-            }
-
-            playing_until = millis() + sample_duration_ms[pick];
-
-            // WiFi interferes with audio playback, so disable it after the first coin
-            if (wifi_active) {
+            // WiFi interferes with audio playback, so disable it after the first coin,
+            // also while it is still trying to connect
+            if (wifi_state != WIFI_STATE_OFF) {
                 server.end();
-                WiFi.disconnect(true);
-                WiFi.mode(WIFI_OFF);
-                mode = NORMAL;
-                wifi_active = false;
-                reactive_wifi_at = millis() + REACTIVATE_WIFI_AFTER;
+                wifi_stop();
                 log("Disabling WiFi to prevent sound interference\n");
             }
-
-            play_sample(pick);
-
         }
 #if REACTIVATE_WIFI_AFTER > 0
-        else if (!wifi_active && millis() >= reactive_wifi_at) {
+        else if (wifi_state == WIFI_STATE_OFF && millis() - last_coin_activity >= REACTIVATE_WIFI_AFTER) {
             // Reactivate WiFi after REACTIVATE_WIFI_AFTER ms
             log("Reactivating WiFi after %d ms\n", REACTIVATE_WIFI_AFTER);
-            WiFi.mode(WIFI_STA);
-            WiFi.begin(SSID, PASSWORD);
-            wifi_active = true;
+            wifi_start();
             server.begin();
         }
 #endif
-
-        DacAudio.FillBuffer();
         break;
     }
     // Restart Signaled! Give time to finish any ongoing tasks
@@ -857,4 +1323,9 @@ void loop() {
         break;
     }
     }
+
+    loop_load.add(micros() - start);
+
+    // Let the idle task on this core run, sensor samples are buffered meanwhile
+    delay(1);
 }
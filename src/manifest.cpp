@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstring>
+
+#include "config.h"
+#include "manifest.h"
+
+#define SEPARATORS " \r\n"    // Between the weights, the firmware writes one per line
+
+bool parse_number(const char* text, uint32_t max, uint32_t& value)
+{
+    uint64_t n = 0;     // Can't overflow, it is checked against max after each digit
+
+    if (!*text) {
+        return false;
+    }
+
+    for (; *text; ++text) {
+        if (*text < '0' || *text > '9') {
+            return false;
+        }
+        n = n * 10 + (*text - '0');
+        if (n > max) {
+            return false;
+        }
+    }
+
+    value = (uint32_t)n;
+    return true;
+}
+
+bool manifest_parse(const char* text, std::vector<uint32_t>& weights)
+{
+    weights.clear();
+    text += strspn(text, SEPARATORS);
+
+    while (*text && weights.size() < MAX_SAMPLES) {
+        const size_t len = strcspn(text, SEPARATORS);
+
+        uint32_t weight;
+        if (!parse_number(std::string(text, len).c_str(), MAX_SAMPLE_WEIGHT, weight)) {
+            return false;
+        }
+        weights.push_back(weight);
+
+        text += len;
+        text += strspn(text, SEPARATORS);
+    }
+
+    return !weights.empty();
+}
+
+std::string manifest_format(const std::vector<uint32_t>& weights)
+{
+    std::string text;
+    for (uint32_t weight : weights) {
+        text += std::to_string(weight) + "\n";
+    }
+    return text;
+}
+
+std::vector<uint32_t> manifest_defaults()
+{
+    constexpr unsigned P = PROBABILITY_MAIN_SAMPLE;
+
+    std::vector<uint32_t> weights(N_SAMPLES);
+    unsigned              remain = 100;
+
+    for (int i = 0; i < N_SAMPLES - 1; ++i) {
+        weights[i] = (P * remain) / 100;
+        remain    -= weights[i];
+    }
+    weights[N_SAMPLES - 1] = remain;
+    return weights;
+}
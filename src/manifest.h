@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Sample slot manifest
+//
+// The manifest on LittleFS (MANIFEST_PATH) lists one slot per line, with the
+// weight the slot is picked with relative to the others, e.g. "70\n21\n9\n".
+// Slots beyond MAX_SAMPLES are ignored.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Parse a number of digits only (no sign, spaces or anything after it) that
+// is at most max. Also used for the numbers given in HTTP requests.
+bool parse_number(const char* text, uint32_t max, uint32_t& value);
+
+// Weights listed in text, false if one isn't a number from 0 to
+// MAX_SAMPLE_WEIGHT or there are none
+bool manifest_parse(const char* text, std::vector<uint32_t>& weights);
+
+// Text of the manifest for weights
+std::string manifest_format(const std::vector<uint32_t>& weights);
+
+// Weights of the N_SAMPLES built-in slots: PROBABILITY_MAIN_SAMPLE percent
+// for the first, the same share of what remains for each following one
+std::vector<uint32_t> manifest_defaults();
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "audio.h"
+#include "mixer.h"
+
+void mix_add(int16_t* mix, const uint8_t* pcm, size_t n, int gain)
+{
+    if (gain == AUDIO_GAIN_UNITY) {
+        for (size_t i = 0; i < n; ++i) {
+            mix[i] += (int16_t)pcm[i] - MIX_SILENCE;
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            mix[i] += (((int16_t)pcm[i] - MIX_SILENCE) * gain) / AUDIO_GAIN_UNITY;
+        }
+    }
+}
+
+void mix_output(const int16_t* mix, uint16_t* frames, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        int16_t s = mix[i];
+        if (s < -MIX_SILENCE)    s = -MIX_SILENCE;
+        if (s > MIX_SILENCE - 1) s = MIX_SILENCE - 1;
+        frames[2 * i]     = (uint16_t)(s + MIX_SILENCE) << 8;
+        frames[2 * i + 1] = (uint16_t)(s + MIX_SILENCE) << 8;
+    }
+}
+
+size_t mix_oldest(const uint32_t* seq, size_t n)
+{
+    size_t oldest = 0;
+    for (size_t i = 1; i < n; ++i) {
+        if ((int32_t)(seq[i] - seq[oldest]) < 0) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Mixing of the audio voices (see audio.h)
+//
+// Kept apart from the I2S output in audio.cpp, so it can be tested on the host.
+
+#include <cstddef>
+#include <cstdint>
+
+#define MIX_SILENCE 0x80    // Midpoint of 8-bit unsigned PCM
+
+// Add n samples of 8-bit unsigned PCM, scaled by gain (AUDIO_GAIN_UNITY is
+// 1.0), to the sums in mix. The sums are relative to MIX_SILENCE.
+void mix_add(int16_t* mix, const uint8_t* pcm, size_t n, int gain);
+
+// Saturate n sums to 8 bits and write them as DAC frames: the DAC takes the
+// upper 8 bits of each 16 bit sample, both channels carry the same sample.
+// Loud overlaps clip instead of wrapping around.
+void mix_output(const int16_t* mix, uint16_t* frames, size_t n);
+
+// The voice to cut off if all n are busy: the one started by the oldest
+// request, seq holds each voice's request. Sequence numbers may wrap around.
+size_t mix_oldest(const uint32_t* seq, size_t n);
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Host replay of recorded sensor data through the coin detector.
+ *
+ * Build and run with PlatformIO:
+ *      pio run -e native
+ *      .pio/build/native/program [options] [recording.csv ...]
+ *
+ * Without files, the recordings in measurements/ are replayed. Recordings are
+ * CSV files with a "time_s,value" header, as written by tools/record_ser.py
+ * and tools/record_udp.py.
+ *
+ * Options (defaults come from config.h):
+ *      --threshold <n>     SPIKE_THRESHOLD
+ *      --noise-factor <f>  SPIKE_NOISE_FACTOR
+ *      --noise-alpha <f>   NOISE_ALPHA
+ *      --spike-max <ms>    SPIKE_MAX_MS
+ *      --alpha <f>         BASELINE_ALPHA
+ *      --samples <n>       ADC_SAMPLES
+ *      --low <n>           LOW_THRESHOLD
+ *      --high <n>          HIGH_THRESHOLD
+ *      --matched           Use the matched filter detector (DETECTOR_MODE)
+ *      --correlation <f>   MATCH_CORRELATION
+ *      --depth <n>         MATCH_MIN_DEPTH
+ *      --compare           Run threshold and matched filter detector side by side
+ *      --quiet             Only print the per-file summary
+ *
+ * The recordings in measurements/ were taken at roughly 200 Hz instead of the
+ * device's 500 Hz, use --samples 2 to get close to the device's averaged
+ * sample period when comparing detectors. With it, both detectors find the
+ * same 4 coins in adc_readings_coin.csv, and the threshold detector rejects
+ * one overlong spike at 19.1 s that the matched filter ignores.
+ */
+
+// The unit tests in test/ are built with the native sources and bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "detector.h"
+
+// Nanosecond clock, the detector's "cycles" are nanoseconds on the host
+class HostClock : public Clock {
+public:
+    uint32_t cycles() override
+    {
+        return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// Replays a recording, using the recorded timestamps as sample times
+class CsvSource : public AdcSource {
+public:
+    bool open(const char* path)
+    {
+        FILE* f = fopen(path, "r");
+        if (!f) {
+            return false;
+        }
+
+        char line[64];
+        double t_s;
+        int value;
+
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "%lf,%d", &t_s, &value) == 2) {
+                AdcSample sample;
+                sample.t_us = (uint32_t)(t_s * 1e6);
+                sample.raw  = (uint16_t)value;
+                samples_.push_back(sample);
+            }
+        }
+
+        fclose(f);
+        return true;
+    }
+
+    bool read(AdcSample& sample) override
+    {
+        if (pos_ >= samples_.size()) {
+            return false;
+        }
+        sample = samples_[pos_++];
+        return true;
+    }
+
+    void rewind() { pos_ = 0; }
+    size_t size() const { return samples_.size(); }
+
+    // Average sample period of the recording
+    uint32_t period_us() const
+    {
+        if (samples_.size() < 2) {
+            return SAMPLE_PERIOD_US;
+        }
+        return (samples_.back().t_us - samples_.front().t_us) / (samples_.size() - 1);
+    }
+
+private:
+    std::vector<AdcSample> samples_;
+    size_t pos_ = 0;
+};
+
+struct ReplayResult {
+    unsigned coins;
+    unsigned lid_threshold;
+    unsigned lid_spike;
+    unsigned reactivated;
+    std::vector<uint32_t> coin_us;  // Timestamps of the detected coins
+};
+
+static ReplayResult* result = nullptr;
+static bool quiet = false;
+
+static void on_event(DetectorEvent event, const DetectorEventInfo& info)
+{
+    const char* what = "";
+
+    switch (event) {
+    case COIN_DETECTED:
+        result->coins++;
+        result->coin_us.push_back(info.t_us);
+        what = "coin";
+        break;
+    case LID_OPEN_THRESHOLD: result->lid_threshold++; what = "rejected: outside thresholds";  break;
+    case LID_OPEN_SPIKE:     result->lid_spike++;     what = "rejected: spike too long";      break;
+    case REACTIVATED:        result->reactivated++;   what = "reactivated";                   break;
+    }
+
+    if (!quiet) {
+        printf("  %9.3f s  %-30s read %4u  baseline %7.2f  diff %5d\n",
+               info.t_us / 1e6, what, info.read, info.baseline, info.diff);
+    }
+}
+
+static const char* mode_name(DetectorMode mode)
+{
+    return mode == DETECT_MATCHED ? "matched" : "threshold";
+}
+
+static ReplayResult run(CsvSource& source, DetectorConfig config)
+{
+    ReplayResult res = ReplayResult();
+    result = &res;
+
+    // Scale the coin template to the recording's sample rate
+    config.sample_period_us = source.period_us();
+
+    HostClock clock;
+    CoinDetector detector(clock, config);
+    detector.on_event(on_event);
+    source.rewind();
+
+    const auto start = std::chrono::steady_clock::now();
+    detector.poll(source);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    const double total_us = std::chrono::duration<double, std::micro>(elapsed).count();
+
+    printf("  %s: coins: %u, rejected: %u (thresholds %u, spike too long %u), reactivated: %u\n",
+           mode_name(config.mode), res.coins, res.lid_threshold + res.lid_spike,
+           res.lid_threshold, res.lid_spike, res.reactivated);
+    printf("  %s: noise %.2f, spike threshold %u\n",
+           mode_name(config.mode), detector.noise(), detector.spike_threshold());
+    printf("  %s: replay: %.1f us total, %.1f ns/raw sample, detector %u ns/avg sample (max %u ns)\n",
+           mode_name(config.mode), total_us, source.size() ? total_us * 1000.0 / source.size() : 0.0,
+           detector.cycles_avg(), detector.cycles_max());
+
+    result = nullptr;
+    return res;
+}
+
+// Count coins found by both detectors (within 100 ms of each other)
+static unsigned common_coins(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+    unsigned n = 0;
+    for (uint32_t ta : a) {
+        for (uint32_t tb : b) {
+            if ((ta > tb ? ta - tb : tb - ta) <= 100000) {
+                n++;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+static bool replay(const char* path, const DetectorConfig& config, bool compare)
+{
+    CsvSource source;
+    if (!source.open(path)) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    printf("%s (%zu samples, %u us/sample)\n", path, source.size(), source.period_us());
+
+    if (!compare) {
+        run(source, config);
+        printf("\n");
+        return true;
+    }
+
+    DetectorConfig threshold = config;
+    DetectorConfig matched   = config;
+    threshold.mode = DETECT_THRESHOLD;
+    matched.mode   = DETECT_MATCHED;
+
+    const ReplayResult t = run(source, threshold);
+    const ReplayResult m = run(source, matched);
+    const unsigned both  = common_coins(t.coin_us, m.coin_us);
+
+    printf("  comparison: both %u, threshold only %u, matched only %u\n\n",
+           both, t.coins - both, m.coins - common_coins(m.coin_us, t.coin_us));
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    DetectorConfig config;
+    std::vector<std::string> files;
+    bool compare = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (!strcmp(arg, "--quiet")) {
+            quiet = true;
+        } else if (!strcmp(arg, "--matched")) {
+            config.mode = DETECT_MATCHED;
+        } else if (!strcmp(arg, "--compare")) {
+            compare = true;
+        } else if (arg[0] == '-' && arg[1] == '-' && !val) {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return 1;
+        } else if (!strcmp(arg, "--threshold")) {
+            config.spike_threshold = atoi(val); ++i;
+        } else if (!strcmp(arg, "--noise-factor")) {
+            config.spike_noise_factor = atof(val); ++i;
+        } else if (!strcmp(arg, "--noise-alpha")) {
+            config.noise_alpha = atof(val); ++i;
+        } else if (!strcmp(arg, "--spike-max")) {
+            config.spike_max_ms = atoi(val); ++i;
+        } else if (!strcmp(arg, "--alpha")) {
+            config.baseline_alpha = atof(val); ++i;
+        } else if (!strcmp(arg, "--samples")) {
+            config.adc_samples = atoi(val); ++i;
+        } else if (!strcmp(arg, "--low")) {
+            config.low_threshold = atoi(val); ++i;
+        } else if (!strcmp(arg, "--high")) {
+            config.high_threshold = atoi(val); ++i;
+        } else if (!strcmp(arg, "--correlation")) {
+            config.match_correlation = atof(val); ++i;
+        } else if (!strcmp(arg, "--depth")) {
+            config.match_min_depth = atoi(val); ++i;
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty()) {
+        files.push_back("measurements/adc_readings_coin.csv");
+        files.push_back("measurements/adc_readings_hand.csv");
+        files.push_back("measurements/adc_readings_openclose.csv");
+    }
+
+    printf("threshold %u (noise factor %.1f, %u..%u), spike max %u ms, alpha %.3f, samples %u, low %u, high %u, correlation %.2f, depth %u\n\n",
+           config.spike_threshold, config.spike_noise_factor, config.spike_threshold_min,
+           config.spike_threshold_max, config.spike_max_ms, config.baseline_alpha,
+           config.adc_samples, config.low_threshold, config.high_threshold,
+           config.match_correlation, config.match_min_depth);
+
+    bool ok = true;
+    for (const auto& file : files) {
+        ok &= replay(file.c_str(), config, compare);
+    }
+
+    return ok ? 0 : 1;
+}
+
+#endif // PIO_UNIT_TESTING
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cmath>
+
+#include "resampler.h"
+
+#define COEFF_ONE     (1 << 14)     // 1.0 in Q14
+#define CUTOFF_MARGIN 0.95f         // Pass band relative to the lower Nyquist frequency, leaves room for the transition band
+
+Resampler::Resampler(uint32_t in_rate, uint32_t out_rate)
+    : in_rate_(in_rate), out_rate_(out_rate), in_count_(0), out_count_(0)
+{
+    // Cutoff in cycles per input sample. When downsampling, the filter is
+    // stretched so it also removes what would alias at the output rate.
+    const float ratio = (out_rate < in_rate) ? (float)out_rate / in_rate : 1.0f;
+    const float fc    = 0.5f * ratio * CUTOFF_MARGIN;
+
+    half_ = (size_t)ceilf(RESAMPLER_ZEROS / (2.0f * fc));
+    taps_ = 2 * half_;
+    coeffs_.resize(RESAMPLER_PHASES * taps_);
+
+    const float pi = 3.14159265f;
+    std::vector<float> h(taps_);
+
+    for (size_t p = 0; p < RESAMPLER_PHASES; ++p) {
+        float sum = 0;
+
+        // Tap k weighs input sample i - half + 1 + k for an output at i + p / PHASES
+        for (size_t k = 0; k < taps_; ++k) {
+            const float x    = (float)k - half_ + 1 - (float)p / RESAMPLER_PHASES;
+            const float arg  = 2.0f * fc * x;
+            const float sinc = (fabsf(arg) < 1e-6f) ? 1.0f : sinf(pi * arg) / (pi * arg);
+            const float w    = (fabsf(x) >= half_) ? 0.0f :
+                               0.42f + 0.5f * cosf(pi * x / half_) + 0.08f * cosf(2.0f * pi * x / half_);   // Blackman
+            h[k] = sinc * w;
+            sum += h[k];
+        }
+
+        // Unity gain at DC, put the rounding error on the largest tap
+        int16_t* c = &coeffs_[p * taps_];
+        int32_t  total = 0;
+        size_t   peak  = 0;
+        for (size_t k = 0; k < taps_; ++k) {
+            c[k]   = (int16_t)lroundf(h[k] / sum * COEFF_ONE);
+            total += c[k];
+            if (c[k] > c[peak]) {
+                peak = k;
+            }
+        }
+        c[peak] += COEFF_ONE - total;
+    }
+
+    // Silence before the first sample, so the first outputs have all their taps
+    hist_.assign(half_ - 1, 0);
+    hist_base_ = -(int64_t)(half_ - 1);
+}
+
+size_t Resampler::output_len(size_t in_len) const
+{
+    return (size_t)(((uint64_t)in_len * out_rate_ + in_rate_ - 1) / in_rate_);
+}
+
+size_t Resampler::max_output(size_t n) const
+{
+    return (size_t)((uint64_t)n * out_rate_ / in_rate_) + 1;
+}
+
+size_t Resampler::emit(uint8_t* out, uint64_t limit)
+{
+    size_t n = 0;
+
+    while (out_count_ < limit) {
+        // Input position of the next output as integer and nearest phase
+        const uint64_t pos   = out_count_ * in_rate_;
+        int64_t        i     = (int64_t)(pos / out_rate_);
+        uint32_t       phase = (uint32_t)(((pos % out_rate_) * RESAMPLER_PHASES + out_rate_ / 2) / out_rate_);
+        if (phase == RESAMPLER_PHASES) {
+            phase = 0;
+            i++;
+        }
+
+        // All taps up to i + half_ must be there
+        if (i + (int64_t)half_ >= hist_base_ + (int64_t)hist_.size()) {
+            break;
+        }
+
+        const int16_t* c = &coeffs_[phase * taps_];
+        const int16_t* x = &hist_[i - (int64_t)half_ + 1 - hist_base_];
+
+        int32_t acc = 0;
+        for (size_t k = 0; k < taps_; ++k) {
+            acc += (int32_t)c[k] * x[k];
+        }
+
+        int32_t s = (acc + COEFF_ONE / 2) >> 14;
+        if (s < -128) s = -128;
+        if (s > 127)  s = 127;
+        out[n++] = (uint8_t)(s + 128);
+        out_count_++;
+    }
+
+    // Drop what no later output needs
+    const int64_t first = (int64_t)(out_count_ * in_rate_ / out_rate_) - (int64_t)half_ + 1;
+    if (first > hist_base_) {
+        const size_t drop = (size_t)(first - hist_base_);
+        hist_.erase(hist_.begin(), hist_.begin() + ((drop < hist_.size()) ? drop : hist_.size()));
+        hist_base_ += drop;
+    }
+
+    return n;
+}
+
+size_t Resampler::process(const uint8_t* in, size_t n, uint8_t* out)
+{
+    for (size_t i = 0; i < n; ++i) {
+        hist_.push_back((int16_t)in[i] - 128);
+    }
+    in_count_ += n;
+
+    return emit(out, UINT64_MAX);
+}
+
+size_t Resampler::flush(uint8_t* out)
+{
+    // Silence after the last sample
+    hist_.insert(hist_.end(), half_ + 1, 0);
+    return emit(out, output_len(in_count_));
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Polyphase sample rate converter
+//
+// Converts 8-bit unsigned mono PCM between arbitrary rates with a windowed
+// sinc low-pass, cut off below the lower of both Nyquist frequencies. The
+// filter is stored as RESAMPLER_PHASES sets of Q14 coefficients, one per
+// fractional input position; every output sample picks the closest set and
+// is computed with integer multiply-accumulates only. Output positions are
+// tracked as an exact fraction, so there is no drift over long clips.
+//
+// The coefficients are computed once per instance in floating point. Input
+// can be fed in chunks of any size, flush() emits the samples still held
+// back by the filter at the end.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define RESAMPLER_PHASES 64     // Filter phases, i.e. resolution of output positions between two input samples
+#define RESAMPLER_ZEROS  8      // Zero crossings of the sinc on each side at the lower Nyquist frequency
+
+class Resampler {
+public:
+    Resampler(uint32_t in_rate, uint32_t out_rate);
+
+    // Number of output samples for in_len input samples
+    size_t output_len(size_t in_len) const;
+
+    // Upper bound of the samples a single process() call with n inputs produces
+    size_t max_output(size_t n) const;
+
+    // Feed n input samples, write the output samples they complete to out. Returns their number.
+    size_t process(const uint8_t* in, size_t n, uint8_t* out);
+
+    // Write the remaining output samples (at most max_output(taps())), returns their number
+    size_t flush(uint8_t* out);
+
+    size_t taps() const { return taps_; }
+
+private:
+    size_t emit(uint8_t* out, uint64_t limit);
+
+    uint32_t             in_rate_;
+    uint32_t             out_rate_;
+    size_t               taps_;         // Coefficients per phase
+    size_t               half_;         // Taps before the output position
+    std::vector<int16_t> coeffs_;       // RESAMPLER_PHASES x taps_, Q14
+    std::vector<int16_t> hist_;         // Input samples (centered around 0) still needed by the filter
+    int64_t              hist_base_;    // Input index of hist_[0]
+    uint64_t             in_count_;     // Input samples fed
+    uint64_t             out_count_;    // Output samples produced
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Fixed-capacity ring buffer that keeps the N most recent values
+//
+// push() is O(1) and overwrites the oldest value once the buffer is full.
+// A single writer may push while other tasks take snapshots: a sequence
+// counter (seqlock) tells readers whether a push happened during their copy,
+// in which case they simply copy again. The writer never waits for readers.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template <typename T, size_t N>
+class RingBuffer {
+public:
+    // Writer side: append a value, dropping the oldest one if full
+    void push(const T& value)
+    {
+        const uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);     // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+
+        buffer_[head_] = value;
+        head_ = (head_ + 1 == N) ? 0 : head_ + 1;
+        if (count_ < N) {
+            count_++;
+        }
+
+        seq_.store(seq + 2, std::memory_order_release);     // Even: consistent again
+    }
+
+    // Reader side: copy the buffered values, oldest first, into out
+    void snapshot(std::vector<T>& out) const
+    {
+        out.reserve(N);
+
+        for (;;) {
+            const uint32_t seq = seq_.load(std::memory_order_acquire);
+            if (seq & 1) {
+                continue; // Writer is busy, try again
+            }
+
+            const size_t head  = head_;
+            const size_t count = count_;
+            const size_t start = (head + N - count) % N;
+
+            out.clear();
+            for (size_t i = 0; i < count; ++i) {
+                out.push_back(buffer_[(start + i) % N]);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                return;
+            }
+        }
+    }
+
+    size_t size() const { return count_; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T buffer_[N];
+    volatile size_t head_  = 0;          // Next slot to write
+    volatile size_t count_ = 0;          // Number of valid values
+    std::atomic<uint32_t> seq_{0};       // Odd while a push is in progress
+};
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <utility>
+
+#include "sample_cache.h"
+
+void SampleCache::resize(size_t n)
+{
+    while (slots_.size() < n) {
+        slots_.emplace_back();
+    }
+}
+
+bool SampleCache::pick(int idx, uint32_t now_ms, uint32_t duration_ms)
+{
+    CachedSample& c = slots_[idx];
+    if (!c.len) {
+        return true;
+    }
+
+    const bool hit = resident(idx);
+    if (hit) {
+        hits_++;
+    } else {
+        misses_++;
+    }
+
+    c.last_used = ++tick_;
+    c.ends_ms   = now_ms + duration_ms;
+    return hit;
+}
+
+bool SampleCache::make_room(int idx, size_t len, uint32_t now_ms, std::vector<DroppedSample>& dropped)
+{
+    while (bytes_ + len > budget_) {
+        int  victim         = -1;
+        bool victim_playing = false;
+
+        // Slot 0 is pinned
+        for (int i = 1; i < (int)slots_.size(); ++i) {
+            if (i == idx || !resident(i)) {
+                continue;
+            }
+
+            const bool playing = (int32_t)(now_ms - slots_[i].ends_ms) < 0;
+            if (victim < 0 || playing < victim_playing ||
+                (playing == victim_playing && slots_[i].last_used < slots_[victim].last_used)) {
+                victim         = i;
+                victim_playing = playing;
+            }
+        }
+
+        if (victim < 0) {
+            return false;
+        }
+
+        drop(victim, dropped);
+        evictions_++;
+    }
+
+    return true;
+}
+
+void SampleCache::insert(int idx, std::vector<uint8_t>& data)
+{
+    CachedSample& c = slots_[idx];
+
+    bytes_ -= c.data.size();
+    bytes_ += data.size();
+    c.data.swap(data);
+    c.last_used = ++tick_;
+}
+
+void SampleCache::drop(int idx, std::vector<DroppedSample>& dropped)
+{
+    CachedSample& c = slots_[idx];
+    if (c.data.empty()) {
+        return;
+    }
+
+    bytes_ -= c.data.size();
+
+    DroppedSample d;
+    d.idx = idx;
+    d.data.swap(c.data);
+    dropped.push_back(std::move(d));
+}
+
+void SampleCache::forget(int idx, std::vector<DroppedSample>& dropped)
+{
+    drop(idx, dropped);
+    slots_[idx] = CachedSample();
+}
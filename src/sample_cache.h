@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Samples kept in RAM
+//
+// Boxes without the samples partition play their samples from RAM. They are
+// read from LittleFS when first picked, and the least recently played ones
+// are dropped again to stay within a budget. Slot 0, by far the most likely
+// pick, is never dropped.
+//
+// SampleCache only keeps the books, reading the samples and making sure the
+// audio engine is done with dropped ones is up to the caller (see samples.cpp).
+// It is not thread safe.
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct CachedSample {
+    size_t               len       = 0;     // Bytes to keep in RAM, 0 if the sample isn't played from RAM
+    uint32_t             crc       = 0;     // CRC32 of the samples, checked whenever they are read
+    uint32_t             last_used = 0;     // Tick of the last play
+    uint32_t             ends_ms   = 0;     // Time at which the last play ends, it isn't dropped before
+    uint16_t             bank      = 0;     // Blob holding the samples (see SampleMeta)
+    std::vector<uint8_t> data;              // The samples, empty while they aren't in RAM
+};
+
+// Samples taken out of the cache. Voices may still be playing them, they are
+// freed once the caller has stopped those.
+struct DroppedSample {
+    int                  idx;
+    std::vector<uint8_t> data;
+};
+
+class SampleCache {
+public:
+    explicit SampleCache(size_t budget) : budget_(budget) {}
+
+    // Make room for n slots, slots are only ever added
+    void resize(size_t n);
+
+    CachedSample&       operator[](int idx) { return slots_[idx]; }
+    const CachedSample& operator[](int idx) const { return slots_[idx]; }
+
+    // Whether the samples of slot idx are in RAM
+    bool resident(int idx) const { return !slots_[idx].data.empty(); }
+
+    // Note that slot idx starts playing at now_ms for duration_ms. False if it
+    // is played from RAM but its samples aren't there (a miss).
+    bool pick(int idx, uint32_t now_ms, uint32_t duration_ms);
+
+    // Drop the least recently played samples until len more bytes for slot idx
+    // fit the budget. Samples that have finished playing at now_ms go first,
+    // one that is still playing is only cut off if nothing else is left. False
+    // if dropping everything else isn't enough.
+    bool make_room(int idx, size_t len, uint32_t now_ms, std::vector<DroppedSample>& dropped);
+
+    // Count len bytes that are being read and not inserted yet
+    void reserve(size_t len) { bytes_ += len; }
+    void unreserve(size_t len) { bytes_ -= len; }
+
+    // Take over data as the samples of slot idx, which isn't in RAM
+    void insert(int idx, std::vector<uint8_t>& data);
+
+    // Take the samples of slot idx out of RAM, its description stays
+    void drop(int idx, std::vector<DroppedSample>& dropped);
+
+    // Forget slot idx altogether, e.g. before its sample is replaced
+    void forget(int idx, std::vector<DroppedSample>& dropped);
+
+    size_t   budget() const { return budget_; }
+    size_t   bytes() const { return bytes_; }
+    uint32_t hits() const { return hits_; }
+    uint32_t misses() const { return misses_; }
+    uint32_t evictions() const { return evictions_; }
+
+private:
+    std::deque<CachedSample> slots_;    // Entries stay in place while slots are added
+    size_t                   budget_;
+    size_t                   bytes_     = 0;
+    uint32_t                 tick_      = 0;
+    uint32_t                 hits_      = 0;
+    uint32_t                 misses_    = 0;
+    uint32_t                 evictions_ = 0;
+};
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdarg>
+#include <cstdio>
+
+#include <esp_rom_crc.h>
+
+#include "adpcm.h"
+#include "config.h"
+#include "sample_converter.h"
+
+SampleWriter::SampleWriter(SampleSink& sink, bool adpcm, size_t stage_limit)
+    : sink_(sink), adpcm_(adpcm), stage_limit_(stage_limit)
+{
+    if (adpcm_) {
+        block_pcm_.reserve(ADPCM_BLOCK_SAMPLES);
+    }
+    block_.reserve(UPLOAD_WRITE_BLOCK);
+}
+
+void SampleWriter::write_pcm(const uint8_t* pcm, size_t n)
+{
+    samples_ += n;
+
+    if (!adpcm_) {
+        write(pcm, n);
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        block_pcm_.push_back(pcm[i]);
+        if (block_pcm_.size() == ADPCM_BLOCK_SAMPLES) {
+            encode_block();
+        }
+    }
+}
+
+void SampleWriter::write(const uint8_t* data, size_t n)
+{
+    crc_  = esp_rom_crc32_le(crc_, data, n);
+    len_ += n;
+
+    if (len_ <= stage_limit_) {
+        staged_.insert(staged_.end(), data, data + n);
+    } else if (!staged_.empty()) {
+        std::vector<uint8_t>().swap(staged_);
+    }
+
+#if UPLOAD_WRITE_BLOCK == 0
+    write_sink(data, n);
+#else
+    // Whole blocks need no copy
+    if (block_.empty() && n >= UPLOAD_WRITE_BLOCK) {
+        const size_t whole = n - n % UPLOAD_WRITE_BLOCK;
+        write_sink(data, whole);
+        data += whole;
+        n    -= whole;
+    }
+
+    while (n) {
+        const size_t c = (n < UPLOAD_WRITE_BLOCK - block_.size()) ? n : UPLOAD_WRITE_BLOCK - block_.size();
+        block_.insert(block_.end(), data, data + c);
+        data += c;
+        n    -= c;
+
+        if (block_.size() == UPLOAD_WRITE_BLOCK) {
+            write_sink(block_.data(), block_.size());
+            block_.clear();
+        }
+    }
+#endif
+}
+
+bool SampleWriter::finish()
+{
+    if (adpcm_ && !block_pcm_.empty()) {
+        encode_block();
+    }
+    if (!block_.empty()) {
+        write_sink(block_.data(), block_.size());
+        block_.clear();
+    }
+    return ok_;
+}
+
+void SampleWriter::write_sink(const uint8_t* data, size_t n)
+{
+    if (ok_ && !sink_.write(data, n)) {
+        ok_ = false;
+    }
+    writes_++;
+}
+
+void SampleWriter::encode_block()
+{
+    uint8_t block[ADPCM_BLOCK_ALIGN];
+    write(block, adpcm_encode_block(block_pcm_.data(), block_pcm_.size(), block, index_));
+    block_pcm_.clear();
+}
+
+SampleConverter::SampleConverter(SampleSink& sink, size_t file_size, bool adpcm, uint16_t gain, size_t stage_limit)
+    : sink_(sink), parser_(file_size), adpcm_(adpcm), gain_(gain), stage_limit_(stage_limit)
+{
+}
+
+bool SampleConverter::feed(const uint8_t* data, size_t n)
+{
+    while (n && ok_) {
+        if (!parser_.done()) {
+            const size_t used = parser_.feed(data, n);
+            data += used;
+            n    -= used;
+
+            if (parser_.failed()) {
+                ok_ = fail("Invalid WAV file: %s", parser_.error());
+            } else if (parser_.done()) {
+                ok_ = begin();
+            }
+            continue;
+        }
+
+        // Anything after the samples (e.g. metadata chunks) is of no interest
+        const size_t c = (n < left_) ? n : left_;
+        if (c == 0) {
+            break;
+        }
+
+        convert(data, c);
+        data  += c;
+        n     -= c;
+        left_ -= c;
+    }
+
+    return ok_;
+}
+
+bool SampleConverter::finish(SampleMeta& meta)
+{
+    if (!ok_) {
+        return false;
+    }
+    if (!parser_.done()) {
+        return fail("Invalid WAV file: truncated");
+    }
+    if (left_) {
+        return fail("%lu B of samples missing", (unsigned long)left_);
+    }
+
+    const ClipInfo& info = parser_.info();
+
+    if (resampler_) {
+        uint8_t* out = converted_.data();
+        writer_->write_pcm(out, resampler_->flush(out));
+    }
+
+    if (!writer_->finish()) {
+        return fail("Writing the samples failed");
+    }
+
+    meta = SampleMeta();
+    meta.magic            = SAMPLE_META_MAGIC;
+    meta.info.offset      = 0;
+    meta.info.len         = writer_->len();
+    meta.info.rate        = SAMPLE_RATE;
+    meta.info.samples     = is_adpcm_ ? info.samples : writer_->samples();
+    meta.info.duration_ms = (uint32_t)((uint64_t)meta.info.samples * 1000 / SAMPLE_RATE);
+    meta.info.channels    = 1;
+    meta.gain             = gain_;
+    meta.crc              = writer_->crc();
+
+    if (encoded() || is_adpcm_) {
+        meta.info.format      = WAV_FORMAT_IMA_ADPCM;
+        meta.info.block_align = ADPCM_BLOCK_ALIGN;
+        meta.info.bits        = 4;
+    } else {
+        meta.info.format      = WAV_FORMAT_PCM;
+        meta.info.block_align = 1;
+        meta.info.bits        = 8;
+    }
+
+    return true;
+}
+
+// Check the format once the header is known and get ready for the samples
+bool SampleConverter::begin()
+{
+    const ClipInfo& info = parser_.info();
+
+    // Samples are converted as they come in, the format must be known by then
+    if (parser_.position() != info.offset) {
+        return fail("Unsupported WAV file, format after the samples");
+    }
+
+    // Uploads that are already ADPCM are stored as they are
+    is_adpcm_ = info.format == WAV_FORMAT_IMA_ADPCM;
+
+    if (info.channels != 1 ||
+        (is_adpcm_ ? info.block_align != ADPCM_BLOCK_ALIGN : (info.format != WAV_FORMAT_PCM || info.bits != 8))) {
+        return fail("Unsupported format (format 0x%x, %u channels, %u bits)", info.format, info.channels, info.bits);
+    }
+
+    if (is_adpcm_ ? info.rate != SAMPLE_RATE : (info.rate < RESAMPLE_MIN_RATE || info.rate > RESAMPLE_MAX_RATE)) {
+        return fail("Unsupported sample rate %lu Hz", (unsigned long)info.rate);
+    }
+
+    left_ = info.len;
+    if (!is_adpcm_ && left_ > (size_t)info.rate * MAX_DURATION) {
+        left_ = (size_t)info.rate * MAX_DURATION;
+    }
+
+    if (!is_adpcm_ && info.rate != SAMPLE_RATE) {
+        resampler_.reset(new Resampler(info.rate, SAMPLE_RATE));
+        converted_.resize(resampler_->max_output(CHUNK + resampler_->taps()));
+    }
+
+    writer_.reset(new SampleWriter(sink_, encoded(), stage_limit_));
+    return true;
+}
+
+void SampleConverter::convert(const uint8_t* data, size_t n)
+{
+    if (is_adpcm_) {
+        writer_->write(data, n);
+    } else if (!resampler_) {
+        writer_->write_pcm(data, n);
+    } else {
+        for (size_t done = 0; done < n; done += CHUNK) {
+            const size_t c = (n - done < CHUNK) ? n - done : CHUNK;
+            writer_->write_pcm(converted_.data(), resampler_->process(data + done, c, converted_.data()));
+        }
+    }
+}
+
+// Note why the conversion failed for error(), returns false
+bool SampleConverter::fail(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(error_, sizeof(error_), fmt, args);
+    va_end(args);
+    return false;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Conversion of uploads into playback-ready samples
+//
+// Samples are stored ready for playback: a blob holds nothing but the samples
+// (8-bit PCM or IMA-ADPCM blocks at SAMPLE_RATE) and a SampleMeta describes
+// them. Uploads are converted once, so booting only reads the metadata and
+// maps or reads the samples, without parsing anything.
+//
+// SampleConverter takes a WAV file front to back in pieces of any size, e.g.
+// as an upload arrives, so it is never stored or read back as a whole. It
+// doesn't know where the samples go: the firmware writes them to a slot's
+// spare blob on LittleFS (see SampleUpdate in main.cpp), the unit tests keep
+// them in memory.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "resampler.h"
+#include "wav.h"
+
+#define SAMPLE_META_MAGIC 0x324D4243 // "CBM2"
+
+// Describes the samples of a slot, stored in /<n>.info
+struct SampleMeta {
+    uint32_t magic;
+    ClipInfo info;          // Describes the blob, offset is always 0
+    uint16_t gain;          // Playback gain, AUDIO_GAIN_UNITY = 1.0
+    uint16_t bank;          // Blob holding the samples, /<n>.pcm (0) or /<n>.pcm1 (1)
+    uint32_t crc;           // CRC32 of the blob
+};
+
+// Destination of the converted samples
+class SampleSink {
+public:
+    virtual ~SampleSink() {}
+    virtual bool write(const uint8_t* data, size_t n) = 0;  // False if not all of it was written
+};
+
+// Writes the samples of a conversion to a sink, encoding them as IMA-ADPCM
+// if requested, and keeps track of their size and checksum. Up to stage_limit
+// bytes are also kept in RAM.
+//
+// The conversion produces pieces of any size, down to a few bytes per upload
+// chunk. They are collected into blocks of UPLOAD_WRITE_BLOCK bytes, so
+// LittleFS programs whole flash pages and updates its metadata once per block
+// instead of once per piece.
+class SampleWriter {
+public:
+    SampleWriter(SampleSink& sink, bool adpcm, size_t stage_limit);
+
+    // Write samples at SAMPLE_RATE
+    void write_pcm(const uint8_t* pcm, size_t n);
+
+    // Write data that is already in its final format
+    void write(const uint8_t* data, size_t n);
+
+    // Write what is left, false if any write to the sink failed
+    bool finish();
+
+    size_t   len() const { return len_; }
+    size_t   samples() const { return samples_; }
+    uint32_t crc() const { return crc_; }
+    size_t   writes() const { return writes_; }
+
+    // All samples written, if they didn't exceed stage_limit
+    std::vector<uint8_t>* staged() { return (len_ <= stage_limit_) ? &staged_ : nullptr; }
+
+private:
+    void write_sink(const uint8_t* data, size_t n);
+    void encode_block();
+
+    SampleSink&          sink_;
+    bool                 ok_      = true;
+    bool                 adpcm_;
+    size_t               stage_limit_;
+    std::vector<uint8_t> staged_;       // Copy of the data written, up to stage_limit_
+    std::vector<uint8_t> block_pcm_;    // Samples of the ADPCM block being collected
+    std::vector<uint8_t> block_;        // Data not yet written to the sink, less than UPLOAD_WRITE_BLOCK
+    uint8_t              index_   = 0;  // ADPCM step index carried from block to block
+    size_t               len_     = 0;
+    size_t               samples_ = 0;
+    size_t               writes_  = 0;  // Writes to the sink
+    uint32_t             crc_     = 0;
+};
+
+// Converts a WAV file into playback-ready samples: resampled to SAMPLE_RATE,
+// cut to MAX_DURATION, optionally encoded as IMA-ADPCM. Files that are
+// already IMA-ADPCM at SAMPLE_RATE are stored as they are.
+class SampleConverter {
+public:
+    // file_size is the size of the whole file, gain goes into the metadata
+    SampleConverter(SampleSink& sink, size_t file_size, bool adpcm, uint16_t gain, size_t stage_limit);
+
+    // Feed the next n bytes of the file, false once it turned out to be unusable
+    bool feed(const uint8_t* data, size_t n);
+
+    // Write the last samples and describe them in meta (bank is left to the
+    // caller). False if the file was unusable, or ended before all the
+    // samples its header declared had arrived.
+    bool finish(SampleMeta& meta);
+
+    // Whether the samples ended before all that the header declared had arrived
+    bool truncated() const { return ok_ && parser_.done() && left_; }
+
+    // Why the conversion failed
+    const char* error() const { return error_; }
+
+    // Sample rate of the file, once its header has been fed
+    uint32_t rate() const { return parser_.done() ? parser_.info().rate : 0; }
+
+    bool resampled() const { return resampler_ != nullptr; }
+    bool encoded() const { return adpcm_ && !is_adpcm_; }
+
+    // Bytes written to the sink and the number of writes it took
+    size_t written() const { return writer_ ? writer_->len() : 0; }
+    size_t writes() const { return writer_ ? writer_->writes() : 0; }
+
+    // All samples, if they didn't exceed stage_limit
+    std::vector<uint8_t>* staged() { return writer_ ? writer_->staged() : nullptr; }
+
+private:
+    bool begin();
+    void convert(const uint8_t* data, size_t n);
+    bool fail(const char* fmt, ...);
+
+    static const size_t CHUNK = 256;    // Input samples resampled at once
+
+    SampleSink&                   sink_;
+    WavParser                     parser_;
+    bool                          adpcm_;
+    uint16_t                      gain_;
+    size_t                        stage_limit_;
+    bool                          ok_        = true;
+    bool                          is_adpcm_  = false;
+    size_t                        left_      = 0;   // Bytes of samples still to come
+    std::unique_ptr<Resampler>    resampler_;
+    std::vector<uint8_t>          converted_;       // Output of the resampler
+    std::unique_ptr<SampleWriter> writer_;
+    char                          error_[80] = "";
+};
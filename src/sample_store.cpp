@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstring>
+
+#include <esp_partition.h>
+
+#include "config.h"
+#include "sample_store.h"
+
+#define REGION_MAGIC  0x32534243    // "CBS2"
+
+// Start of every region. Written after the payload, so a region whose write
+// was interrupted never looks valid.
+struct RegionHeader {
+    uint32_t magic;
+    uint32_t len;       // Payload size in bytes
+    uint32_t crc;       // CRC32 of the payload
+    uint32_t reserved;
+};
+
+static_assert(SAMPLE_REGION_SIZE % SPI_FLASH_SEC_SIZE == 0, "SAMPLE_REGION_SIZE must be a multiple of the flash sector size");
+
+static const esp_partition_t*  partition = nullptr;
+static const uint8_t*          mapped    = nullptr;
+static spi_flash_mmap_handle_t map_handle;
+
+static const RegionHeader* region_header(int slot)
+{
+    return reinterpret_cast<const RegionHeader*>(mapped + (size_t)slot * SAMPLE_REGION_SIZE);
+}
+
+static const uint8_t* region_payload(int slot)
+{
+    return mapped + (size_t)slot * SAMPLE_REGION_SIZE + sizeof(RegionHeader);
+}
+
+static bool slot_valid(int slot)
+{
+    return mapped && slot >= 0 && (size_t)(slot + 1) * SAMPLE_REGION_SIZE <= partition->size;
+}
+
+bool store_begin()
+{
+    if (mapped) {
+        return true;
+    }
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SAMPLE_PARTITION);
+    if (!partition) {
+        return false;
+    }
+
+    const void* ptr = nullptr;
+    if (esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &ptr, &map_handle) != ESP_OK) {
+        partition = nullptr;
+        return false;
+    }
+
+    mapped = static_cast<const uint8_t*>(ptr);
+    return true;
+}
+
+bool store_available()
+{
+    return mapped != nullptr;
+}
+
+size_t store_capacity()
+{
+    return SAMPLE_REGION_SIZE - sizeof(RegionHeader);
+}
+
+// Whether the region already holds a payload of len bytes with checksum crc
+static bool region_current(int slot, size_t len, uint32_t crc)
+{
+    const RegionHeader* hdr = region_header(slot);
+    return hdr->magic == REGION_MAGIC && hdr->len == len && hdr->crc == crc;
+}
+
+// Erase only what a payload of len bytes needs
+static bool region_erase(int slot, size_t len)
+{
+    const size_t used = (sizeof(RegionHeader) + len + SPI_FLASH_SEC_SIZE - 1) & ~(size_t)(SPI_FLASH_SEC_SIZE - 1);
+    return esp_partition_erase_range(partition, (size_t)slot * SAMPLE_REGION_SIZE, used) == ESP_OK;
+}
+
+static bool region_write(int slot, size_t offset, const uint8_t* data, size_t n)
+{
+    return esp_partition_write(partition, (size_t)slot * SAMPLE_REGION_SIZE + sizeof(RegionHeader) + offset,
+                               data, n) == ESP_OK;
+}
+
+// Write the header, which makes the payload valid
+static bool region_commit(int slot, size_t len, uint32_t crc)
+{
+    RegionHeader hdr = {};
+    hdr.magic = REGION_MAGIC;
+    hdr.len   = len;
+    hdr.crc   = crc;
+    return esp_partition_write(partition, (size_t)slot * SAMPLE_REGION_SIZE, &hdr, sizeof(hdr)) == ESP_OK;
+}
+
+bool store_write(int slot, File& file, size_t offset, size_t len, uint32_t crc)
+{
+    if (!slot_valid(slot) || len > store_capacity()) {
+        return false;
+    }
+
+    if (region_current(slot, len, crc)) {
+        return true;
+    }
+
+    if (!region_erase(slot, len)) {
+        return false;
+    }
+
+    uint8_t chunk[256];
+
+    file.seek(offset);
+    for (size_t done = 0; done < len;) {
+        const size_t n = file.read(chunk, (len - done < sizeof(chunk)) ? len - done : sizeof(chunk));
+        if (n == 0 || !region_write(slot, done, chunk, n)) {
+            return false;
+        }
+        done += n;
+    }
+
+    return region_commit(slot, len, crc);
+}
+
+bool store_write(int slot, const uint8_t* data, size_t len, uint32_t crc)
+{
+    if (!slot_valid(slot) || len > store_capacity()) {
+        return false;
+    }
+
+    if (region_current(slot, len, crc)) {
+        return true;
+    }
+
+    return region_erase(slot, len) && (len == 0 || region_write(slot, 0, data, len)) && region_commit(slot, len, crc);
+}
+
+bool store_clip(int slot, AudioClip& clip)
+{
+    if (!slot_valid(slot)) {
+        return false;
+    }
+
+    const RegionHeader* hdr = region_header(slot);
+    if (hdr->magic != REGION_MAGIC || hdr->len > store_capacity()) {
+        return false;
+    }
+
+    clip.data  = region_payload(slot);
+    clip.len   = hdr->len;
+    clip.flash = true;
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Sample storage in memory-mapped flash
+//
+// The SAMPLE_PARTITION data partition (see partitions.csv) is split into
+// fixed regions of SAMPLE_REGION_SIZE bytes, one per sample slot. Each region
+// holds a small header followed by the raw PCM payload. The whole partition
+// is mapped into the data address space once, so clips are played straight
+// from flash (through the flash cache) without a copy in RAM.
+//
+// Boxes updated over the air keep their old partition table. Without the
+// partition, store_available() is false and samples have to be kept in RAM.
+
+#include <cstddef>
+#include <cstdint>
+
+#include <FS.h>
+
+#include "audio.h"
+
+bool   store_begin();           // Find and map the partition, false if it doesn't exist
+bool   store_available();       // Whether the partition was found and mapped
+size_t store_capacity();        // Maximum payload size of a region in bytes
+
+// Copy len bytes starting at offset of file into the region of slot. crc is
+// the CRC32 of those bytes and is kept in the region's header: the region is
+// only rewritten if its length or checksum differ, so calling this on every
+// boot neither wears out the flash nor needs to read the file.
+bool store_write(int slot, File& file, size_t offset, size_t len, uint32_t crc);
+
+// Same, for samples that are still in RAM (e.g. right after an upload)
+bool store_write(int slot, const uint8_t* data, size_t len, uint32_t crc);
+
+// Point clip at the mapped payload of slot, false if the region holds no valid payload
+bool store_clip(int slot, AudioClip& clip);
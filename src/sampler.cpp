@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "config.h"
+#include "sampler.h"
+#include "spsc_ring.h"
+
+static SpscRing<AdcSample, SAMPLE_RING_SIZE> ring;     // Timer callback -> detector
+static esp_timer_handle_t timer = nullptr;
+static volatile bool running = false;
+static volatile uint32_t overruns = 0;
+
+// Runs in the esp_timer task every SAMPLE_PERIOD_US.
+// The esp_timer task has a higher priority than loop(), so the sampling
+// cadence is unaffected by audio buffer fills, serial logging or flash access.
+static void sample_cb(void*)
+{
+    AdcSample sample;
+    sample.t_us = micros();
+    sample.raw  = analogRead(SENSOR_PIN);
+
+    if (!ring.push(sample)) {
+        overruns = overruns + 1;
+    }
+}
+
+void sampler_begin()
+{
+    if (running) {
+        return;
+    }
+
+    // Drop stale samples left over from a previous run
+    AdcSample discard;
+    while (ring.pop(discard));
+
+    if (!timer) {
+        esp_timer_create_args_t args = {};
+        args.callback        = &sample_cb;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name            = "adc_sampler";
+
+        if (esp_timer_create(&args, &timer) != ESP_OK) {
+            timer = nullptr;
+            return;
+        }
+    }
+
+    if (esp_timer_start_periodic(timer, SAMPLE_PERIOD_US) == ESP_OK) {
+        running = true;
+    }
+}
+
+void sampler_end()
+{
+    if (!running) {
+        return;
+    }
+
+    esp_timer_stop(timer);
+    running = false;
+}
+
+bool sampler_pop(AdcSample& sample)
+{
+    return ring.pop(sample);
+}
+
+uint32_t sampler_overruns()
+{
+    return overruns;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Sensor acquisition
+//
+// Raw ADC values are sampled every SAMPLE_PERIOD_US by a periodic esp_timer
+// and queued into a lock-free ring, independent of what loop() is doing.
+// The coin detector drains the ring with sampler_pop(). All functions except
+// the timer callback must be called from the task consuming the samples.
+
+#include <cstdint>
+
+#include "hal.h"
+
+void     sampler_begin();                   // Start periodic sampling (no-op if already running)
+void     sampler_end();                     // Stop sampling
+bool     sampler_pop(AdcSample& sample);    // Fetch the oldest queued sample, false if none
+uint32_t sampler_overruns();                // Number of samples dropped because nobody consumed them in time
+
+// Exposes the sampler to the detector
+class SamplerSource : public AdcSource {
+public:
+    bool read(AdcSample& sample) override { return sampler_pop(sample); }
+};
@@ -0,0 +1,720 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+#include <sounds.h>
+
+#include "config.h"
+#include "log.h"
+#include "manifest.h"
+#include "sample_store.h"
+#include "samples.h"
+#include "wav.h"
+
+size_t n_samples = 0;
+std::deque<uint32_t> probabilities;
+std::deque<File> sample_files;
+std::deque<AudioStream> sample_streams;
+std::deque<AudioClip> clips;
+std::deque<uint32_t> sample_duration_ms;
+
+// Slot 0 is loaded right away (see load_clip()), the others when they are first picked
+SampleCache sample_cache(SAMPLE_CACHE_BUDGET);
+
+static SemaphoreHandle_t cache_mutex;   // Guards sample_cache, busy and the clips of slots that aren't busy
+static QueueHandle_t     load_queue;    // Samples picked while not in RAM, read and played by serve_loads()
+static std::deque<bool>  busy;          // Slots being loaded (see load_clip()), they aren't played meanwhile
+
+void samples_begin()
+{
+    cache_mutex = xSemaphoreCreateMutex();
+    load_queue  = xQueueCreate(LOAD_QUEUE_LEN, sizeof(int));
+}
+
+// Make room for slot idx in the per-slot state
+void grow_slots(size_t idx)
+{
+    while (clips.size() <= idx) {
+        probabilities.push_back(0);
+        sample_files.emplace_back();
+        sample_streams.emplace_back();
+        clips.emplace_back();
+        sample_duration_ms.push_back(0);
+        busy.push_back(false);
+    }
+    sample_cache.resize(clips.size());
+}
+
+// Use the weights of the slots listed in a manifest
+static void set_weights(const std::vector<uint32_t>& weights)
+{
+    grow_slots(weights.size() - 1);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        probabilities[i] = weights[i];
+    }
+    n_samples = weights.size();
+}
+
+// Weights of the built-in slots
+static void default_weights()
+{
+    set_weights(manifest_defaults());
+}
+
+static bool read_manifest()
+{
+    File f = LittleFS.open(MANIFEST_PATH, "r");
+    if (!f) {
+        return false;
+    }
+
+    std::vector<char> text(f.size() + 1, '\0');
+    f.readBytes(text.data(), text.size() - 1);
+    f.close();
+
+    std::vector<uint32_t> weights;
+    if (!manifest_parse(text.data(), weights)) {
+        return false;
+    }
+
+    set_weights(weights);
+    return true;
+}
+
+bool write_manifest()
+{
+    const std::vector<uint32_t> weights(probabilities.begin(), probabilities.begin() + n_samples);
+    const std::string           text = manifest_format(weights);
+
+    File f = LittleFS.open(MANIFEST_PATH, "w");
+    if (!f) {
+        return false;
+    }
+
+    const bool ok = f.write(reinterpret_cast<const uint8_t*>(text.c_str()), text.size()) == text.size();
+    f.close();
+    return ok;
+}
+
+// Load the sample slots from the manifest, or create it for the built-in samples
+void init_manifest()
+{
+    if (!read_manifest()) {
+        log("No valid manifest, using the built-in samples\n");
+        default_weights();
+        write_manifest();
+    }
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < n_samples; ++i) {
+        total += probabilities[i];
+    }
+
+    log("Probabilities initialised:\n");
+    for (size_t i = 0; i < n_samples; ++i) {
+        log("\tSample %u: %lu%%\n", (unsigned)i, total ? (unsigned long)(probabilities[i] * 100 / total) : 0UL);
+    }
+}
+
+// Make sure the audio engine and the stream task are done with a sample before it changes
+static void release_clip(int idx)
+{
+    audio_stop(&clips[idx]);
+    sample_streams[idx].close();
+}
+
+// Every slot has two blobs of samples (see sample_converter.h), /<n>.pcm and
+// /<n>.pcm1, described by /<n>.info. New samples are written to the one not
+// in use, and replacing /<n>.info (see write_meta()) switches over to them. A
+// conversion that fails or is interrupted at any point leaves the slot as it
+// was.
+static String sample_path(int idx, const char* ext)
+{
+    return "/" + String(idx) + ext;
+}
+
+static String blob_path(int idx, int bank)
+{
+    return sample_path(idx, bank ? ".pcm1" : ".pcm");
+}
+
+static bool read_meta(int idx, SampleMeta& meta)
+{
+    File f = LittleFS.open(sample_path(idx, ".info"), "r");
+    if (!f) {
+        return false;
+    }
+
+    const bool ok = f.read(reinterpret_cast<uint8_t*>(&meta), sizeof(meta)) == sizeof(meta) &&
+                    meta.magic == SAMPLE_META_MAGIC && meta.bank <= 1;
+    f.close();
+    return ok;
+}
+
+// Written to a temporary file first, renaming it over the old one is atomic on LittleFS
+static bool write_meta(int idx, const SampleMeta& meta)
+{
+    const String tmp = sample_path(idx, ".info.new");
+
+    File f = LittleFS.open(tmp, "w");
+    if (!f) {
+        return false;
+    }
+
+    const bool ok = f.write(reinterpret_cast<const uint8_t*>(&meta), sizeof(meta)) == sizeof(meta);
+    f.close();
+
+    return ok && LittleFS.rename(tmp, sample_path(idx, ".info"));
+}
+
+// Stop the samples dropped from the cache and free them. cache_mutex must not
+// be held, stopping waits for the audio task.
+static void free_dropped(std::vector<DroppedSample>& dropped)
+{
+    for (const DroppedSample& d : dropped) {
+        audio_stop(&clips[d.idx]);
+
+        // Unless the slot was loaded again meanwhile
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        if (!busy[d.idx] && clips[d.idx].data == d.data.data()) {
+            clips[d.idx].data = nullptr;
+            clips[d.idx].len  = 0;
+        }
+        xSemaphoreGive(cache_mutex);
+    }
+    dropped.clear();
+}
+
+// Read the samples of a slot played from RAM and check them
+static bool read_samples(int idx, uint16_t bank, size_t len, uint32_t crc, std::vector<uint8_t>& data)
+{
+    data.resize(len);
+
+    File f = LittleFS.open(blob_path(idx, bank), "r");
+    const bool ok = f && f.read(data.data(), len) == len && esp_rom_crc32_le(0, data.data(), len) == crc;
+    f.close();
+
+    if (!ok) {
+        log("Sample %d: Checksum mismatch\n", idx);
+        std::vector<uint8_t>().swap(data);
+    }
+    return ok;
+}
+
+// Read a sample handed over by play_sample() into RAM and play it. Neither
+// reading the file nor stopping the samples dropped to make room for it holds
+// cache_mutex, so picking other samples doesn't wait for them. The room it
+// takes is reserved in the budget meanwhile.
+static void cache_fill(int idx)
+{
+    std::vector<DroppedSample> dropped;
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    const CachedSample& slot   = sample_cache[idx];
+    const size_t        len    = slot.len;
+    const uint32_t      crc    = slot.crc;
+    const uint16_t      bank   = slot.bank;
+    const bool          wanted = len && !busy[idx];
+    const bool          loaded = wanted && sample_cache.resident(idx);     // Picked twice in a row
+    const bool          room   = wanted && !loaded && sample_cache.make_room(idx, len, millis(), dropped);
+    if (room) {
+        sample_cache.reserve(len);
+    }
+    if (loaded) {
+        audio_play(&clips[idx]);
+    }
+    xSemaphoreGive(cache_mutex);
+
+    free_dropped(dropped);
+
+    if (!room) {
+        if (wanted && !loaded) {
+            log("Sample %d: No room in the sample cache\n", idx);
+        }
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    const bool ok = read_samples(idx, bank, len, crc, data);
+
+    // The slot may have been replaced while it was read
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    sample_cache.unreserve(len);
+    if (ok && !busy[idx] && slot.len == len && slot.crc == crc && !sample_cache.resident(idx)) {
+        sample_cache.insert(idx, data);
+        clips[idx].data = slot.data.data();
+        clips[idx].len  = len;
+        audio_play(&clips[idx]);
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+// Stop and forget a sample before its files change. It isn't played again
+// until load_clip() is done with it.
+static void unload_clip(int idx)
+{
+    std::vector<DroppedSample> dropped;
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    busy[idx] = true;
+    sample_cache.forget(idx, dropped);
+    xSemaphoreGive(cache_mutex);
+
+    // Its samples are freed on return, once nothing plays them any more
+    release_clip(idx);
+
+    clips[idx]              = AudioClip();
+    sample_duration_ms[idx] = 0;
+
+    if (sample_files[idx]) {
+        sample_files[idx].close();
+    }
+}
+
+// Built-in sound of slot idx, a WAV file in the firmware image (see sounds.h)
+static void factory_sound(int idx, const uint8_t*& wav, size_t& len)
+{
+    switch(idx) {
+    case 1:
+        wav = powerup;
+        len = sizeof(powerup);
+        break;
+    case 2:
+        wav = oneup;
+        len = sizeof(oneup);
+        break;
+    default:
+        wav = coin; // Default to coin sound
+        len = sizeof(coin);
+    }
+}
+
+// Slots without a sample of their own play their built-in sound straight from
+// the firmware image, which is memory-mapped like the samples partition. It
+// takes no RAM and nothing is written to LittleFS, so going back to it only
+// means deleting the slot's files. Returns false if the sound can't be played
+// as it is (it isn't 8-bit PCM at SAMPLE_RATE).
+static bool load_factory_clip(int idx)
+{
+    const uint8_t* wav;
+    size_t         len;
+    ClipInfo       info;
+
+    factory_sound(idx, wav, len);
+    if (!wav_parse(wav, len, info) || info.format != WAV_FORMAT_PCM || info.channels != 1 ||
+        info.bits != 8 || info.rate != SAMPLE_RATE) {
+        return false;
+    }
+
+    clips[idx].data  = wav + info.offset;
+    clips[idx].len   = (info.len < SAMPLE_SIZE) ? info.len : SAMPLE_SIZE;
+    clips[idx].flash = true;
+
+    sample_duration_ms[idx] = (uint32_t)((uint64_t)clips[idx].len * 1000 / SAMPLE_RATE);
+
+    log("Sample %d played from the firmware image (built-in sound), duration: %lu ms\n",
+        idx, (unsigned long)sample_duration_ms[idx]);
+    return true;
+}
+
+// Whether a slot's own sample is just a copy of its built-in sound, as written
+// by older firmware versions
+static bool is_factory_copy(int idx, const SampleMeta& meta)
+{
+    const uint8_t* wav;
+    size_t         len;
+    ClipInfo       info;
+
+    factory_sound(idx, wav, len);
+    if (!wav_parse(wav, len, info) || meta.info.format != info.format || meta.gain != AUDIO_GAIN_UNITY) {
+        return false;
+    }
+
+    const size_t bytes = (info.len < SAMPLE_SIZE) ? info.len : SAMPLE_SIZE;
+    return meta.info.len == bytes && meta.crc == esp_rom_crc32_le(0, wav + info.offset, bytes);
+}
+
+// Keep the samples of slot idx in RAM, taken from staged or read from its
+// file. Samples dropped to make room are stopped without holding cache_mutex.
+static void cache_keep(int idx, std::vector<uint8_t>* staged)
+{
+    const CachedSample&        slot = sample_cache[idx];
+    std::vector<DroppedSample> dropped;
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    const bool room = sample_cache.make_room(idx, slot.len, millis(), dropped);
+    if (room) {
+        sample_cache.reserve(slot.len);
+    }
+    xSemaphoreGive(cache_mutex);
+
+    free_dropped(dropped);
+
+    if (!room) {
+        log("Sample %d: No room in the sample cache\n", idx);
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    if (staged) {
+        data.swap(*staged);
+    } else {
+        read_samples(idx, slot.bank, slot.len, slot.crc, data);
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    sample_cache.unreserve(slot.len);
+    if (!data.empty()) {
+        sample_cache.insert(idx, data);
+        clips[idx].data = slot.data.data();
+        clips[idx].len  = slot.len;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+
+// Set up the clip of slot idx after unload_clip(), while it isn't played
+static void open_clip(int idx, std::vector<uint8_t>* staged)
+{
+    SampleMeta meta;
+    if (!read_meta(idx, meta)) {
+        if (!load_factory_clip(idx)) {
+            log("No metadata for sample %d\n", idx);
+        }
+        return;
+    }
+
+    const String path = blob_path(idx, meta.bank);
+
+    sample_files[idx] = LittleFS.open(path, "r");
+    if (!sample_files[idx] || sample_files[idx].size() != meta.info.len) {
+        log("Sample %d: Samples missing or don't match the metadata\n", idx);
+        sample_files[idx].close();
+        return;
+    }
+
+    const size_t payload_bytes = meta.info.len;
+
+    // Samples just converted are still in RAM, they don't need to be read again
+    if (staged && staged->size() != payload_bytes) {
+        staged = nullptr;
+    }
+
+    // Play the samples straight from the samples partition if possible
+    if ((staged ? store_write(idx, staged->data(), payload_bytes, meta.crc)
+                : store_write(idx, sample_files[idx], 0, payload_bytes, meta.crc)) &&
+        store_clip(idx, clips[idx])) {
+        log("Sample %d mapped from flash\n", idx);
+    }
+    // Too large for RAM, stream it from LittleFS
+    else if (payload_bytes > STREAM_ABOVE &&
+             sample_streams[idx].open(path.c_str(), 0, payload_bytes)) {
+        clips[idx].len    = payload_bytes;
+        clips[idx].stream = &sample_streams[idx];
+        log("Sample %d streamed from LittleFS\n", idx);
+    }
+    // Otherwise (no partition, e.g. after an OTA update from an older layout), play it from RAM
+    else {
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        sample_cache[idx].len  = payload_bytes;
+        sample_cache[idx].crc  = meta.crc;
+        sample_cache[idx].bank = meta.bank;
+        xSemaphoreGive(cache_mutex);
+
+        // Keep the staged samples if there is room. Slot 0 is picked most of
+        // the time, keep it loaded for good. Others are loaded when picked.
+        if (staged || idx == 0) {
+            cache_keep(idx, staged);
+        }
+
+        if (idx == 0 && !clips[idx].len) {
+            return;
+        }
+        log("Sample %d played from RAM%s\n", idx, clips[idx].len ? "" : ", loaded when picked");
+    }
+
+    clips[idx].adpcm   = meta.info.format == WAV_FORMAT_IMA_ADPCM;
+    clips[idx].samples = meta.info.samples;
+    clips[idx].gain    = meta.gain;
+
+    // Duration of the samples alone, metadata chunks of the uploaded file don't count
+    sample_duration_ms[idx] = meta.info.duration_ms;
+
+    // Trim to MAX_DURATION (failsafe if bad payload)
+    if (sample_duration_ms[idx] > MAX_DURATION * 1000UL) {
+        sample_duration_ms[idx] = MAX_DURATION * 1000UL;
+    }
+
+    log("Sample %d duration: %lu ms%s\n",
+        idx, (unsigned long)sample_duration_ms[idx], clips[idx].adpcm ? " (ADPCM)" : "");
+}
+
+// Load sample idx as described by its metadata, or its built-in sound if it has
+// none. staged may hold its samples if they are still in RAM, they are taken
+// over instead of being read again. The slot isn't played meanwhile, so
+// cache_mutex is only held while the cache changes, not while files are read
+// or the samples partition is written.
+static void load_clip(int idx, std::vector<uint8_t>* staged = nullptr)
+{
+    unload_clip(idx);
+    open_clip(idx, staged);
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    busy[idx] = false;
+    xSemaphoreGive(cache_mutex);
+}
+
+bool FileSink::write(const uint8_t* data, size_t n)
+{
+    if (!opened_) {
+        file_   = LittleFS.open(path_, "w");
+        opened_ = true;
+    }
+    return file_ && file_.write(data, n) == n;
+}
+
+SampleUpdate::SampleUpdate(int idx, size_t file_size, bool adpcm, uint16_t gain)
+    : idx_(idx), bank_(spare_bank(idx)), sink_(blob_path(idx, bank_)),
+      converter_(sink_, file_size, adpcm, gain, STREAM_ABOVE)
+{
+}
+
+SampleUpdate::~SampleUpdate()
+{
+    if (sink_.opened() && !committed_) {
+        sink_.close();
+        LittleFS.remove(blob_path(idx_, bank_));
+    }
+}
+
+bool SampleUpdate::feed(const uint8_t* data, size_t n)
+{
+    return converter_.feed(data, n) || failed();
+}
+
+bool SampleUpdate::commit()
+{
+    SampleMeta meta;
+    if (!converter_.finish(meta)) {
+        return failed();
+    }
+    sink_.close();
+
+    // The switch to the new blob
+    meta.bank = bank_;
+    if (!write_meta(idx_, meta)) {
+        return false;
+    }
+    committed_ = true;
+
+    if (converter_.resampled()) {
+        log("Sample %d: Resampled from %lu Hz to %d Hz\n", idx_, (unsigned long)converter_.rate(), SAMPLE_RATE);
+    }
+    if (converter_.encoded()) {
+        log("Sample %d: Encoded as IMA-ADPCM\n", idx_);
+    }
+
+    load_clip(idx_, converter_.staged());
+    LittleFS.remove(blob_path(idx_, !bank_));
+    return true;
+}
+
+int SampleUpdate::spare_bank(int idx)
+{
+    SampleMeta current;
+    return (read_meta(idx, current) && current.bank == 0) ? 1 : 0;
+}
+
+bool SampleUpdate::failed()
+{
+    if (!logged_) {
+        log("Sample %d: %s\n", idx_, converter_.error());
+        logged_ = true;
+    }
+    return false;
+}
+
+// Convert the WAV file src into the playback-ready samples of slot idx and load them
+static bool convert_sample(int idx, const String& src, bool adpcm, uint16_t gain)
+{
+    File in = LittleFS.open(src, "r");
+    if (!in) {
+        return false;
+    }
+
+    SampleUpdate update(idx, in.size(), adpcm, gain);
+
+    // Static, /reset runs on the async TCP task's small stack
+    static uint8_t chunk[256];
+    size_t n;
+    while ((n = in.read(chunk, sizeof(chunk))) > 0 && update.feed(chunk, n));
+
+    in.close();
+    return update.commit();
+}
+
+// Convert the built-in sound of slot idx like an upload, only needed if it
+// can't be played from the firmware image as it is (see load_factory_clip())
+static bool install_default_sample(int idx)
+{
+    const uint8_t* wav;
+    size_t         len;
+
+    factory_sound(idx, wav, len);
+
+    SampleUpdate update(idx, len, false, AUDIO_GAIN_UNITY);
+    return update.feed(wav, len) && update.commit();
+}
+
+// Initialize/Load samples from LittleFS or create default ones if they don't exist
+void init_samples() {
+    for (int i = 0; i < (int)n_samples; ++i) {
+        SampleMeta meta;
+        bool       own = read_meta(i, meta);
+
+        // Takes up space on LittleFS for nothing
+        if (own && i < N_SAMPLES && is_factory_copy(i, meta)) {
+            LittleFS.remove(sample_path(i, ".info"));
+            LittleFS.remove(blob_path(i, 0));
+            LittleFS.remove(blob_path(i, 1));
+            log("Sample %d: Removed the copy of the built-in sound\n", i);
+            own = false;
+        }
+
+        if (own && LittleFS.exists(blob_path(i, meta.bank))) {
+            // Left behind by an interrupted conversion
+            if (LittleFS.exists(blob_path(i, !meta.bank))) {
+                LittleFS.remove(blob_path(i, !meta.bank));
+            }
+
+            // Load the sample into memory
+            load_clip(i);
+            continue;
+        }
+
+        // Metadata without samples is of no use
+        if (own) {
+            LittleFS.remove(sample_path(i, ".info"));
+        }
+
+        // Uploaded by an older firmware version as a WAV file
+        const String wav = sample_path(i, ".wav");
+
+        if (LittleFS.exists(wav) && convert_sample(i, wav, false, AUDIO_GAIN_UNITY)) {
+            LittleFS.remove(wav);
+            log("Converted sample %d from %s\n", i, wav.c_str());
+            continue;
+        }
+
+        // No sample of its own, play the built-in sound
+        load_clip(i);
+        if (!clips[i].len && !install_default_sample(i)) {
+            log("FATAL: Failed to create sample %d\n", i);
+            while(true);
+        }
+    }
+}
+
+// Reset samples to factory defaults, only in CONFIG mode (see the /reset route)
+void reset_samples() {
+    log("Factory reset: resetting samples to defaults...\n");
+
+    // Delete the uploaded samples and forget the slots that were added at
+    // runtime. The descriptor goes first, without it the blobs are unused.
+    for (size_t i = 0; i < n_samples; ++i) {
+        unload_clip(i);
+
+        LittleFS.remove(sample_path(i, ".info"));
+        LittleFS.remove(blob_path(i, 0));
+        LittleFS.remove(blob_path(i, 1));
+    }
+
+    default_weights();
+    write_manifest();
+
+    // The built-in sounds are played from the firmware image, nothing to write
+    for (int i = 0; i < N_SAMPLES; ++i) {
+        load_clip(i);
+        if (!clips[i].len && !install_default_sample(i)) {
+            log("Failed to reset sample %d\n", i);
+        }
+    }
+}
+
+// Play a sample by index. A sample played from RAM that was dropped or never
+// loaded can't be played right away, it is handed to serve_loads(), which
+// reads it and plays it once it is in RAM. Slots that are being loaded aren't
+// played.
+void play_sample(int idx)
+{
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+
+    if (!busy[idx]) {
+        if (!sample_cache.pick(idx, millis(), sample_duration_ms[idx])) {
+            if (xQueueSend(load_queue, &idx, 0) != pdTRUE) {
+                log("Sample %d: Too many samples waiting to be loaded\n", idx);
+            }
+        } else if (clips[idx].len) {
+            // Requested under the lock, so a later drop stops it (see free_dropped())
+            audio_play(&clips[idx]);
+        }
+    }
+
+    xSemaphoreGive(cache_mutex);
+}
+
+// Pick a random sample based on probabilities
+unsigned int pick_sample() {
+    uint32_t total = 0;
+    for (size_t i = 0; i < n_samples; ++i) {
+        total += probabilities[i];
+    }
+
+    if (total == 0) {
+        log("WARNING: All sample weights are 0, falling back to first sample\n");
+        return 0;
+    }
+
+    uint32_t r = random(total);
+    uint32_t cumulative = 0;
+    for (unsigned int i = 0; i < n_samples; ++i) {
+        cumulative += probabilities[i];
+        if (r < cumulative) {
+            log("Playing sample %u\n", i);
+            return i;
+        }
+    }
+
+    // Should not happen, but just in case
+    log("WARNING: Failed to pick sample, falling back to first sample\n");
+    return 0;
+}
+
+void serve_loads()
+{
+    int idx;
+    while (true) {
+        if (xQueueReceive(load_queue, &idx, portMAX_DELAY) == pdTRUE) {
+            cache_fill(idx);
+        }
+    }
+}
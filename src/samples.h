@@ -0,0 +1,120 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Sample slots
+//
+// The sample slots are listed in the manifest on LittleFS (see init_manifest()),
+// their number is only known at runtime. Slots are only ever added, in CONFIG
+// mode, and std::deque keeps existing entries in place while it grows, so the
+// audio engine's pointers to clips stay valid.
+//
+// A slot's samples are played from the samples partition if possible, and
+// otherwise streamed from LittleFS if they are large or kept in RAM (see
+// sample_cache.h). Slots without a sample of their own play their built-in
+// sound from the firmware image.
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "audio.h"
+#include "audio_stream.h"
+#include "sample_cache.h"
+#include "sample_converter.h"
+
+extern size_t                  n_samples;           // Number of slots in the manifest
+extern std::deque<uint32_t>    probabilities;       // Relative weight of each sample
+extern std::deque<File>        sample_files;        // Samples of each slot, closed for built-in sounds
+extern std::deque<AudioStream> sample_streams;      // Read-ahead state of samples streamed from LittleFS
+extern std::deque<AudioClip>   clips;               // PCM payload of each sample
+extern std::deque<uint32_t>    sample_duration_ms;
+extern SampleCache             sample_cache;        // Samples played from RAM
+
+void         samples_begin();               // Create the lock and queue, before anything else
+void         grow_slots(size_t idx);        // Make room for slot idx in the per-slot state
+bool         write_manifest();              // Write the weights of the n_samples slots to the manifest
+void         init_manifest();
+void         init_samples();
+void         reset_samples();
+void         play_sample(int idx);
+unsigned int pick_sample();
+
+// Read the samples played from RAM that were picked while not loaded and play
+// them, never returns. Called by the load task once the samples are loaded.
+void serve_loads();
+
+// LittleFS file the samples of a conversion are written to. It is only
+// created once the first samples arrive.
+class FileSink : public SampleSink {
+public:
+    explicit FileSink(const String& path) : path_(path) {}
+
+    bool write(const uint8_t* data, size_t n) override;
+
+    void close() { file_.close(); }
+    bool opened() const { return opened_; }
+
+private:
+    String path_;
+    File   file_;
+    bool   opened_ = false;
+};
+
+// Converts a WAV file into the samples of slot idx (see SampleConverter).
+// They are written to the slot's spare blob while they come in and replace
+// the current ones on commit(). Until then, the slot keeps its previous
+// sample.
+class SampleUpdate {
+public:
+    SampleUpdate(int idx, size_t file_size, bool adpcm, uint16_t gain);
+    ~SampleUpdate();
+
+    // Feed the next n bytes of the file, false once it turned out to be unusable
+    bool feed(const uint8_t* data, size_t n);
+
+    bool     truncated() const { return converter_.truncated(); }
+    uint32_t rate() const { return converter_.rate(); }
+    size_t   written() const { return converter_.written(); }
+    size_t   writes() const { return converter_.writes(); }
+
+    // Make the converted samples the slot's and load them. Only once all the
+    // samples the file declared have arrived, a cut off upload keeps the old one.
+    bool commit();
+
+private:
+    // The blob the slot doesn't use
+    static int spare_bank(int idx);
+
+    // Log why the conversion failed, once. Always returns false.
+    bool failed();
+
+    int             idx_;
+    int             bank_;
+    FileSink        sink_;
+    SampleConverter converter_;
+    bool            committed_ = false;
+    bool            logged_    = false;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Single-producer/single-consumer lock-free ring buffer
+//
+// Exactly one context may call push() and exactly one (other) context may call
+// pop(). The producer only ever writes head, the consumer only ever writes tail,
+// so no locks are needed. Head and tail are free-running counters, which is why
+// the capacity must be a power of two.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    // Starts both counters at start instead of 0, so tests can cross their
+    // wrap-around at 2^32 without pushing billions of items first
+    explicit SpscRing(uint32_t start) : head_(start), tail_(start) {}
+
+    // Producer side: returns false (and drops the item) if the ring is full
+    bool push(const T& item)
+    {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        const uint32_t tail = tail_.load(std::memory_order_acquire);
+
+        if (head - tail >= N) {
+            return false;
+        }
+
+        buffer_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: returns false if the ring is empty
+    bool pop(T& item)
+    {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        const uint32_t head = head_.load(std::memory_order_acquire);
+
+        if (head == tail) {
+            return false;
+        }
+
+        item = buffer_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Number of items currently queued (approximate if called concurrently)
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T buffer_[N];
+    std::atomic<uint32_t> head_{0}; // Written by the producer only
+    std::atomic<uint32_t> tail_{0}; // Written by the consumer only
+};
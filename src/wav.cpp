@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstring>
+
+#include "wav.h"
+
+static uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t get32(const uint8_t* p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+
+WavParser::WavParser(size_t file_size)
+    : state_(RIFF_HEADER), file_size_(file_size), pos_(0), buf_len_(0), need_(12), chunk_left_(0),
+      have_fmt_(false), have_data_(false), fact_samples_(0), error_(nullptr), info_()
+{
+}
+
+void WavParser::fail(const char* msg)
+{
+    state_ = FAILED;
+    error_ = msg;
+}
+
+size_t WavParser::feed(const uint8_t* data, size_t n)
+{
+    size_t used = 0;
+
+    while (used < n) {
+        if (state_ == DONE || state_ == FAILED) {
+            break;
+        }
+
+        if (state_ == SKIP) {
+            const size_t c = (chunk_left_ < n - used) ? chunk_left_ : n - used;
+            used += c;
+            skip(c);
+            continue;
+        }
+
+        // Collect a header or chunk body in buf_
+        size_t c = need_ - buf_len_;
+        if (c > n - used) {
+            c = n - used;
+        }
+        memcpy(buf_ + buf_len_, data + used, c);
+        buf_len_ += c;
+        pos_     += c;
+        used     += c;
+
+        if (buf_len_ < need_) {
+            continue;
+        }
+
+        if (state_ == RIFF_HEADER) {
+            if (memcmp(buf_, "RIFF", 4) != 0 || memcmp(buf_ + 8, "WAVE", 4) != 0) {
+                fail("not a WAV file");
+            } else {
+                next_chunk();
+            }
+        } else if (state_ == CHUNK_HEADER) {
+            chunk_header();
+        } else {
+            chunk_body();
+        }
+    }
+
+    return used;
+}
+
+size_t WavParser::skip_ahead() const
+{
+    return (state_ == SKIP) ? chunk_left_ : 0;
+}
+
+void WavParser::skip(size_t n)
+{
+    if (state_ != SKIP) {
+        return;
+    }
+    if (n > chunk_left_) {
+        n = chunk_left_;
+    }
+
+    pos_        += n;
+    chunk_left_ -= n;
+    if (chunk_left_ == 0) {
+        next_chunk();
+    }
+}
+
+void WavParser::chunk_header()
+{
+    const uint32_t size   = get32(buf_ + 4);
+    const size_t   left   = (pos_ < file_size_) ? file_size_ - pos_ : 0;
+    size_t         padded = (size_t)size + (size & 1);
+
+    // A truncated file ends with its last chunk
+    if (padded > left) {
+        padded = left;
+    }
+
+    buf_len_ = 0;
+
+    if (memcmp(buf_, "fmt ", 4) == 0) {
+        if (size < 16 || padded < 16) {
+            fail("fmt chunk too short");
+            return;
+        }
+        need_       = (size < sizeof(buf_)) ? size : sizeof(buf_);
+        chunk_left_ = padded - need_;
+        state_      = FMT;
+    } else if (memcmp(buf_, "fact", 4) == 0 && padded >= 4) {
+        need_       = 4;
+        chunk_left_ = padded - 4;
+        state_      = FACT;
+    } else if (memcmp(buf_, "data", 4) == 0) {
+        have_data_   = true;
+        info_.offset = pos_;
+        info_.len    = (size < left) ? size : left;
+
+        // The samples themselves are of no interest, unless the format comes after them
+        chunk_left_ = padded;
+        if (have_fmt_ || chunk_left_ == 0) {
+            next_chunk();
+        } else {
+            state_ = SKIP;
+        }
+    } else {
+        chunk_left_ = padded;
+        if (chunk_left_ == 0) {
+            next_chunk();
+        } else {
+            state_ = SKIP;
+        }
+    }
+}
+
+void WavParser::chunk_body()
+{
+    if (state_ == FMT) {
+        info_.format      = get16(buf_);
+        info_.channels    = get16(buf_ + 2);
+        info_.rate        = get32(buf_ + 4);
+        info_.block_align = get16(buf_ + 12);
+        info_.bits        = get16(buf_ + 14);
+        have_fmt_         = true;
+
+        if (info_.rate == 0 || info_.channels == 0) {
+            fail("invalid fmt chunk");
+            return;
+        }
+    } else if (state_ == FACT) {
+        fact_samples_ = get32(buf_);
+    }
+
+    buf_len_ = 0;
+    if (chunk_left_) {
+        state_ = SKIP;
+    } else {
+        next_chunk();
+    }
+}
+
+void WavParser::next_chunk()
+{
+    if (have_fmt_ && have_data_) {
+        const uint32_t ch = info_.channels;
+        const uint32_t b  = info_.block_align;
+
+        if (info_.format == WAV_FORMAT_PCM) {
+            const uint32_t frame = b ? b : ch * ((info_.bits + 7) / 8);
+            info_.samples = frame ? info_.len / frame : 0;
+        } else if (info_.format == WAV_FORMAT_IMA_ADPCM && b > 4 * ch) {
+            // Every block starts with one sample per channel, followed by two samples per byte
+            const uint32_t per_block = (b - 4 * ch) * 2 / ch + 1;
+            const uint32_t rest      = info_.len % b;
+            info_.samples = (info_.len / b) * per_block + ((rest > 4 * ch) ? (rest - 4 * ch) * 2 / ch + 1 : 0);
+            if (fact_samples_ && fact_samples_ < info_.samples) {
+                info_.samples = fact_samples_;
+            }
+        } else {
+            info_.samples = fact_samples_;
+        }
+
+        info_.duration_ms = (uint32_t)((uint64_t)info_.samples * 1000 / info_.rate);
+        state_ = DONE;
+        return;
+    }
+
+    if (pos_ + 8 > file_size_) {
+        fail(have_data_ ? "no fmt chunk" : "no data chunk");
+        return;
+    }
+
+    state_   = CHUNK_HEADER;
+    need_    = 8;
+    buf_len_ = 0;
+}
+
+bool wav_parse(const uint8_t* data, size_t len, ClipInfo& info)
+{
+    WavParser parser(len);
+    parser.feed(data, len);
+
+    if (!parser.done()) {
+        return false;
+    }
+
+    info = parser.info();
+    return true;
+}
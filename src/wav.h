@@ -0,0 +1,97 @@
+#pragma once
+
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// WAV (RIFF) files
+//
+// WavParser walks the chunks of a WAV file and fills in a ClipInfo with
+// everything needed to play it: where the samples are, their format and the
+// exact duration. Chunks other than "fmt ", "fact" and "data" (e.g. LIST or
+// id3 metadata, which may come before or after the samples) are skipped.
+//
+// The parser is fed the file front to back in pieces of any size and never
+// needs more than a few bytes of it at once. Callers reading from a file can
+// seek over the chunks it skips instead of reading them (see skip_ahead()).
+
+#include <cstddef>
+#include <cstdint>
+
+#define WAV_FORMAT_PCM          0x0001
+#define WAV_FORMAT_IMA_ADPCM    0x0011
+#define WAV_PCM_HEADER          44      // Size of a plain 8-bit PCM header (RIFF, fmt and data chunk headers)
+
+// Compact description of a clip, all that's left of a WAV file's header once parsed
+struct ClipInfo {
+    uint32_t offset;        // Start of the sample data in the file
+    uint32_t len;           // Bytes of sample data
+    uint32_t rate;          // Samples per second
+    uint32_t samples;       // Number of samples
+    uint32_t duration_ms;   // samples / rate, rounded down
+    uint16_t format;        // WAV_FORMAT_*
+    uint16_t block_align;   // Bytes per block (ADPCM) or per sample (PCM)
+    uint8_t  channels;
+    uint8_t  bits;          // Bits per sample
+    uint16_t reserved;
+};
+
+class WavParser {
+public:
+    explicit WavParser(size_t file_size);
+
+    // Parse the next n bytes of the file. Returns the number of bytes used,
+    // fewer than n once parsing is complete or failed.
+    size_t feed(const uint8_t* data, size_t n);
+
+    // Bytes the parser is going to ignore next. Instead of feeding them, a
+    // caller may skip them and continue reading at position().
+    size_t skip_ahead() const;
+    void   skip(size_t n);
+    size_t position() const { return pos_; }
+
+    bool            done() const { return state_ == DONE; }
+    bool            failed() const { return state_ == FAILED; }
+    const char*     error() const { return error_; }
+    const ClipInfo& info() const { return info_; }
+
+private:
+    enum State { RIFF_HEADER, CHUNK_HEADER, FMT, FACT, SKIP, DONE, FAILED };
+
+    void fail(const char* msg);
+    void chunk_header();
+    void chunk_body();
+    void next_chunk();
+
+    State       state_;
+    size_t      file_size_;
+    size_t      pos_;               // Bytes of the file parsed or skipped
+    uint8_t     buf_[20];           // Header or chunk body being collected
+    size_t      buf_len_;
+    size_t      need_;              // Bytes to collect into buf_
+    size_t      chunk_left_;        // Bytes of the current chunk after what is collected, including the pad byte
+    bool        have_fmt_;
+    bool        have_data_;
+    uint32_t    fact_samples_;
+    const char* error_;
+    ClipInfo    info_;
+};
+
+// Parse a WAV file held in memory
+bool wav_parse(const uint8_t* data, size_t len, ClipInfo& info);
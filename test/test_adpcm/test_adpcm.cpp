@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// IMA-ADPCM round trip of the built-in sounds, run with: pio test -e native
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <unity.h>
+
+#include "adpcm.h"
+#include "sounds.h"
+#include "wav.h"
+
+#define MIN_SNR_DB  18      // Lowest acceptable signal to noise ratio of a decoded sound
+#define MAX_ERROR   32      // Largest acceptable deviation of a single decoded sample
+
+void setUp() {}
+void tearDown() {}
+
+// Encode samples the way SampleWriter does: full blocks, the step index
+// carried from block to block
+static std::vector<uint8_t> encode(const uint8_t* pcm, size_t n)
+{
+    std::vector<uint8_t> out;
+    uint8_t block[ADPCM_BLOCK_ALIGN];
+    uint8_t index = 0;
+
+    for (size_t done = 0; done < n; done += ADPCM_BLOCK_SAMPLES) {
+        const size_t c = (n - done < ADPCM_BLOCK_SAMPLES) ? n - done : ADPCM_BLOCK_SAMPLES;
+        const size_t len = adpcm_encode_block(pcm + done, c, block, index);
+        out.insert(out.end(), block, block + len);
+    }
+    return out;
+}
+
+// Decode n samples a block at a time, the way the audio engine does
+static std::vector<uint8_t> decode(const std::vector<uint8_t>& data, size_t n)
+{
+    std::vector<uint8_t> out;
+    uint8_t pcm[ADPCM_BLOCK_SAMPLES];
+
+    for (size_t start = 0; start < data.size(); start += ADPCM_BLOCK_ALIGN) {
+        const size_t len  = (data.size() - start < ADPCM_BLOCK_ALIGN) ? data.size() - start : ADPCM_BLOCK_ALIGN;
+        const size_t done = start / ADPCM_BLOCK_ALIGN * ADPCM_BLOCK_SAMPLES;
+        const size_t got  = adpcm_decode_block(data.data() + start, len, n - done, pcm);
+        out.insert(out.end(), pcm, pcm + got);
+    }
+    return out;
+}
+
+static void round_trip(const uint8_t* wav, size_t size)
+{
+    ClipInfo info;
+    TEST_ASSERT_TRUE(wav_parse(wav, size, info));
+    TEST_ASSERT_EQUAL(WAV_FORMAT_PCM, info.format);
+
+    const uint8_t*             pcm = wav + info.offset;
+    const std::vector<uint8_t> enc = encode(pcm, info.samples);
+    TEST_ASSERT_EQUAL_UINT32(adpcm_encoded_size(info.samples), enc.size());
+
+    const std::vector<uint8_t> dec = decode(enc, info.samples);
+    TEST_ASSERT_EQUAL_UINT32(info.samples, dec.size());
+
+    double signal = 0;
+    double noise  = 0;
+    int    worst  = 0;
+    for (size_t i = 0; i < dec.size(); ++i) {
+        const int err = (int)dec[i] - pcm[i];
+        signal += ((int)pcm[i] - 128) * ((int)pcm[i] - 128);
+        noise  += err * err;
+        if (abs(err) > worst) {
+            worst = abs(err);
+        }
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_ERROR, worst);
+    TEST_ASSERT_GREATER_THAN(MIN_SNR_DB, 10 * log10(signal / noise));
+}
+
+void test_coin()    { round_trip(coin, sizeof(coin)); }
+void test_powerup() { round_trip(powerup, sizeof(powerup)); }
+void test_oneup()   { round_trip(oneup, sizeof(oneup)); }
+
+// An even sample count leaves a padding nibble in the last byte, it must not
+// come out as an extra sample
+void test_padding_nibble()
+{
+    const uint8_t pcm[] = { 128, 140, 150, 160 };
+    uint8_t block[ADPCM_BLOCK_ALIGN];
+    uint8_t out[ADPCM_BLOCK_SAMPLES];
+    uint8_t index = 0;
+
+    for (size_t n = 1; n <= sizeof(pcm); ++n) {
+        const size_t len = adpcm_encode_block(pcm, n, block, index);
+        TEST_ASSERT_EQUAL_UINT32(adpcm_encoded_size(n), len);
+        TEST_ASSERT_EQUAL_UINT32(n, adpcm_decode_block(block, len, n, out));
+        TEST_ASSERT_EQUAL_UINT8(pcm[0], out[0]);
+    }
+
+    // Without a limit, the whole block is decoded
+    const size_t len = adpcm_encode_block(pcm, sizeof(pcm), block, index);
+    TEST_ASSERT_EQUAL_UINT32(adpcm_block_samples(len), adpcm_decode_block(block, len, ADPCM_BLOCK_SAMPLES, out));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_coin);
+    RUN_TEST(test_powerup);
+    RUN_TEST(test_oneup);
+    RUN_TEST(test_padding_nibble);
+    return UNITY_END();
+}
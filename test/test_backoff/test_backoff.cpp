@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Delays between WiFi connection attempts, run with: pio test -e native
+
+#include <unity.h>
+
+#include "backoff.h"
+#include "config.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Delays of the first n retries
+static void check(Backoff& backoff, const uint32_t* expected, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        TEST_ASSERT_EQUAL_UINT32(expected[i], backoff.delay());
+        backoff.grow();
+    }
+}
+
+// Doubled after every failure, up to the limit
+void test_sequence()
+{
+    Backoff        backoff(1000, 60000);
+    const uint32_t expected[] = { 1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000 };
+    check(backoff, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// A connection starts over
+void test_reset()
+{
+    Backoff backoff(1000, 60000);
+    for (int i = 0; i < 10; ++i) {
+        backoff.grow();
+    }
+
+    backoff.reset();
+    const uint32_t expected[] = { 1000, 2000, 4000 };
+    check(backoff, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// The configured delays, from WIFI_RETRY_MIN up to WIFI_RETRY_MAX
+void test_config()
+{
+    Backoff  backoff(WIFI_RETRY_MIN, WIFI_RETRY_MAX);
+    uint32_t last = 0;
+
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t delay = backoff.delay();
+        TEST_ASSERT_TRUE(delay >= WIFI_RETRY_MIN && delay <= WIFI_RETRY_MAX);
+        TEST_ASSERT_TRUE(delay == 2 * last || delay == WIFI_RETRY_MAX || i == 0);
+        last = delay;
+        backoff.grow();
+    }
+    TEST_ASSERT_EQUAL_UINT32(WIFI_RETRY_MAX, backoff.delay());
+}
+
+// Limits that aren't a power of two times the first delay, or close to the
+// largest delay, are reached without overflowing
+void test_limits()
+{
+    Backoff        odd(2, 7);
+    const uint32_t expected[] = { 2, 4, 7, 7 };
+    check(odd, expected, sizeof(expected) / sizeof(expected[0]));
+
+    Backoff large(0x40000000, 0xffffffff);
+    const uint32_t huge[] = { 0x40000000, 0x80000000, 0xffffffff, 0xffffffff };
+    check(large, huge, sizeof(huge) / sizeof(huge[0]));
+
+    Backoff fixed(500, 500);
+    const uint32_t same[] = { 500, 500 };
+    check(fixed, same, sizeof(same) / sizeof(same[0]));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sequence);
+    RUN_TEST(test_reset);
+    RUN_TEST(test_config);
+    RUN_TEST(test_limits);
+    return UNITY_END();
+}
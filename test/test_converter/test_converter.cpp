@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Uploads through SampleConverter into memory, the way the firmware converts
+// them into a slot's blob. Run with: pio test -e native
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unity.h>
+
+#include <esp_rom_crc.h>
+
+#include "adpcm.h"
+#include "audio.h"
+#include "config.h"
+#include "sample_converter.h"
+#include "sounds.h"
+#include "wav.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Keeps the samples in memory instead of a LittleFS file
+class MemorySink : public SampleSink {
+public:
+    bool write(const uint8_t* p, size_t n) override
+    {
+        writes.push_back(n);
+        if (full) {
+            return false;
+        }
+        data.insert(data.end(), p, p + n);
+        return true;
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<size_t>  writes;    // Size of each write
+    bool                 full = false;
+};
+
+static void put16(std::vector<uint8_t>& v, uint16_t x) { v.push_back(x); v.push_back(x >> 8); }
+static void put32(std::vector<uint8_t>& v, uint32_t x) { put16(v, x); put16(v, x >> 16); }
+static void tag(std::vector<uint8_t>& v, const char* t) { v.insert(v.end(), t, t + 4); }
+
+// WAV file holding n samples of a tone at rate, the header declares declared samples
+static std::vector<uint8_t> wav_file(size_t n, uint32_t rate, size_t declared, uint16_t bits = 8)
+{
+    std::vector<uint8_t> v;
+    tag(v, "RIFF");
+    put32(v, 36 + declared);
+    tag(v, "WAVE");
+    tag(v, "fmt ");
+    put32(v, 16);
+    put16(v, WAV_FORMAT_PCM);
+    put16(v, 1);
+    put32(v, rate);
+    put32(v, rate * bits / 8);
+    put16(v, bits / 8);
+    put16(v, bits);
+    tag(v, "data");
+    put32(v, declared);
+    for (size_t i = 0; i < n; ++i) {
+        v.push_back(128 + (int)(100 * sin(i * 0.05)));
+    }
+    return v;
+}
+
+// Feed file in pieces of piece bytes, the way upload chunks arrive
+static bool feed(SampleConverter& conv, const std::vector<uint8_t>& file, size_t piece)
+{
+    for (size_t pos = 0; pos < file.size(); pos += piece) {
+        const size_t n = (file.size() - pos < piece) ? file.size() - pos : piece;
+        if (!conv.feed(file.data() + pos, n)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A built-in sound at SAMPLE_RATE is stored as it is, metadata chunks after
+// the samples are dropped
+void test_pcm()
+{
+    ClipInfo info;
+    TEST_ASSERT_TRUE(wav_parse(coin, sizeof(coin), info));
+
+    MemorySink      sink;
+    SampleConverter conv(sink, sizeof(coin), false, AUDIO_GAIN_UNITY / 2, STREAM_ABOVE);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, std::vector<uint8_t>(coin, coin + sizeof(coin)), 1436));
+    TEST_ASSERT_TRUE(conv.finish(meta));
+
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_META_MAGIC, meta.magic);
+    TEST_ASSERT_EQUAL(WAV_FORMAT_PCM, meta.info.format);
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_RATE, meta.info.rate);
+    TEST_ASSERT_EQUAL_UINT32(info.len, meta.info.len);
+    TEST_ASSERT_EQUAL_UINT32(info.samples, meta.info.samples);
+    TEST_ASSERT_EQUAL_UINT32(info.duration_ms, meta.info.duration_ms);
+    TEST_ASSERT_EQUAL(AUDIO_GAIN_UNITY / 2, meta.gain);
+
+    TEST_ASSERT_EQUAL(info.len, sink.data.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(coin + info.offset, sink.data.data(), info.len);
+    TEST_ASSERT_EQUAL_UINT32(esp_rom_crc32_le(0, coin + info.offset, info.len), meta.crc);
+
+    // Small enough to be kept in RAM for loading it right away
+    TEST_ASSERT_NOT_NULL(conv.staged());
+    TEST_ASSERT_TRUE(*conv.staged() == sink.data);
+}
+
+void test_resample()
+{
+    const std::vector<uint8_t> file = wav_file(8000, 8000, 8000);
+
+    MemorySink      sink;
+    SampleConverter conv(sink, file.size(), false, AUDIO_GAIN_UNITY, 0);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, file, 1000));
+    TEST_ASSERT_TRUE(conv.finish(meta));
+
+    TEST_ASSERT_TRUE(conv.resampled());
+    TEST_ASSERT_EQUAL_UINT32(8000, conv.rate());
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_RATE, meta.info.rate);
+    TEST_ASSERT_EQUAL_UINT32(Resampler(8000, SAMPLE_RATE).output_len(8000), meta.info.samples);
+    TEST_ASSERT_EQUAL_UINT32(1000, meta.info.duration_ms);
+    TEST_ASSERT_EQUAL(meta.info.len, sink.data.size());
+
+    // Too large to be kept in RAM
+    TEST_ASSERT_NULL(conv.staged());
+}
+
+void test_adpcm()
+{
+    const std::vector<uint8_t> file = wav_file(8000, SAMPLE_RATE, 8000);
+
+    MemorySink      sink;
+    SampleConverter conv(sink, file.size(), true, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, file, 1000));
+    TEST_ASSERT_TRUE(conv.finish(meta));
+
+    TEST_ASSERT_TRUE(conv.encoded());
+    TEST_ASSERT_EQUAL(WAV_FORMAT_IMA_ADPCM, meta.info.format);
+    TEST_ASSERT_EQUAL(ADPCM_BLOCK_ALIGN, meta.info.block_align);
+    TEST_ASSERT_EQUAL_UINT32(8000, meta.info.samples);
+    TEST_ASSERT_EQUAL_UINT32(adpcm_encoded_size(8000), meta.info.len);
+    TEST_ASSERT_EQUAL(meta.info.len, sink.data.size());
+    TEST_ASSERT_EQUAL_UINT32(esp_rom_crc32_le(0, sink.data.data(), sink.data.size()), meta.crc);
+}
+
+// An upload that ends before all the samples its header declares have
+// arrived is rejected, so the slot keeps its previous sample
+void test_truncated()
+{
+    const std::vector<uint8_t> file = wav_file(5000, SAMPLE_RATE, 8000);
+
+    // The request announced the whole file
+    MemorySink      sink;
+    SampleConverter conv(sink, WAV_PCM_HEADER + 8000, false, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, file, 1000));
+    TEST_ASSERT_FALSE(conv.finish(meta));
+    TEST_ASSERT_TRUE(conv.truncated());
+    TEST_ASSERT_EQUAL_STRING("3000 B of samples missing", conv.error());
+}
+
+// Cut off within the header
+void test_truncated_header()
+{
+    const std::vector<uint8_t> file = wav_file(0, SAMPLE_RATE, 8000);
+
+    MemorySink      sink;
+    SampleConverter conv(sink, WAV_PCM_HEADER + 8000, false, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(conv.feed(file.data(), 20));
+    TEST_ASSERT_FALSE(conv.finish(meta));
+    TEST_ASSERT_FALSE(conv.truncated());
+    TEST_ASSERT_EQUAL_STRING("Invalid WAV file: truncated", conv.error());
+    TEST_ASSERT_EQUAL(0, sink.writes.size());
+}
+
+void test_unsupported()
+{
+    SampleMeta meta;
+
+    const std::vector<uint8_t> wide = wav_file(8000, SAMPLE_RATE, 8000, 16);
+    MemorySink                 sink;
+    SampleConverter            conv(sink, wide.size(), false, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    TEST_ASSERT_FALSE(feed(conv, wide, 1000));
+    TEST_ASSERT_FALSE(conv.finish(meta));
+    TEST_ASSERT_FALSE(conv.truncated());
+    TEST_ASSERT_EQUAL_STRING("Unsupported format (format 0x1, 1 channels, 16 bits)", conv.error());
+
+    const std::vector<uint8_t> slow = wav_file(8000, RESAMPLE_MIN_RATE - 1, 8000);
+    SampleConverter            conv2(sink, slow.size(), false, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    TEST_ASSERT_FALSE(feed(conv2, slow, 1000));
+    TEST_ASSERT_FALSE(conv2.finish(meta));
+    TEST_ASSERT_EQUAL_STRING("Unsupported sample rate 7999 Hz", conv2.error());
+
+    TEST_ASSERT_EQUAL(0, sink.writes.size());
+}
+
+// Longer samples are cut to MAX_DURATION
+void test_max_duration()
+{
+    const size_t               n    = SAMPLE_RATE * MAX_DURATION + 1000;
+    const std::vector<uint8_t> file = wav_file(n, SAMPLE_RATE, n);
+
+    MemorySink      sink;
+    SampleConverter conv(sink, file.size(), false, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, file, 1436));
+    TEST_ASSERT_TRUE(conv.finish(meta));
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_SIZE, meta.info.len);
+    TEST_ASSERT_EQUAL_UINT32(MAX_DURATION * 1000, meta.info.duration_ms);
+}
+
+// A full LittleFS fails the conversion instead of describing samples that aren't there
+void test_write_failed()
+{
+    const std::vector<uint8_t> file = wav_file(8000, SAMPLE_RATE, 8000);
+
+    MemorySink sink;
+    sink.full = true;
+
+    SampleConverter conv(sink, file.size(), false, AUDIO_GAIN_UNITY, STREAM_ABOVE);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, file, 1000));
+    TEST_ASSERT_FALSE(conv.finish(meta));
+    TEST_ASSERT_EQUAL_STRING("Writing the samples failed", conv.error());
+}
+
+// Whatever the size of the pieces, the samples reach the sink in whole
+// blocks of UPLOAD_WRITE_BLOCK bytes, only the last write is shorter
+void test_write_blocks()
+{
+    const size_t               n        = 3 * SAMPLE_RATE;
+    const std::vector<uint8_t> file     = wav_file(n, SAMPLE_RATE, n);
+    const size_t               pieces[] = { 1, 7, 1436, 10000 };
+
+    for (size_t piece : pieces) {
+        MemorySink      sink;
+        SampleConverter conv(sink, file.size(), false, AUDIO_GAIN_UNITY, 0);
+        SampleMeta      meta;
+        TEST_ASSERT_TRUE(feed(conv, file, piece));
+        TEST_ASSERT_TRUE(conv.finish(meta));
+
+        TEST_ASSERT_EQUAL(n, sink.data.size());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(file.data() + WAV_PCM_HEADER, sink.data.data(), n);
+        TEST_ASSERT_EQUAL(sink.writes.size(), conv.writes());
+
+#if UPLOAD_WRITE_BLOCK > 0
+        // Pieces of several blocks are written without a copy, a few blocks at once
+        TEST_ASSERT_LESS_OR_EQUAL((n + UPLOAD_WRITE_BLOCK - 1) / UPLOAD_WRITE_BLOCK, sink.writes.size());
+        for (size_t i = 0; i + 1 < sink.writes.size(); ++i) {
+            TEST_ASSERT_EQUAL(0, sink.writes[i] % UPLOAD_WRITE_BLOCK);
+        }
+        if (piece < UPLOAD_WRITE_BLOCK) {
+            TEST_ASSERT_EQUAL((n + UPLOAD_WRITE_BLOCK - 1) / UPLOAD_WRITE_BLOCK, sink.writes.size());
+        }
+#endif
+    }
+}
+
+// ADPCM blocks are collected the same way
+void test_write_blocks_adpcm()
+{
+    const size_t               n    = 3 * SAMPLE_RATE;
+    const std::vector<uint8_t> file = wav_file(n, SAMPLE_RATE, n);
+
+    MemorySink      sink;
+    SampleConverter conv(sink, file.size(), true, AUDIO_GAIN_UNITY, 0);
+    SampleMeta      meta;
+    TEST_ASSERT_TRUE(feed(conv, file, 1436));
+    TEST_ASSERT_TRUE(conv.finish(meta));
+    TEST_ASSERT_EQUAL(adpcm_encoded_size(n), sink.data.size());
+
+#if UPLOAD_WRITE_BLOCK > 0
+    TEST_ASSERT_EQUAL((sink.data.size() + UPLOAD_WRITE_BLOCK - 1) / UPLOAD_WRITE_BLOCK, sink.writes.size());
+#endif
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pcm);
+    RUN_TEST(test_resample);
+    RUN_TEST(test_adpcm);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_truncated_header);
+    RUN_TEST(test_unsupported);
+    RUN_TEST(test_max_duration);
+    RUN_TEST(test_write_failed);
+    RUN_TEST(test_write_blocks);
+    RUN_TEST(test_write_blocks_adpcm);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Parsing of the sample manifest and of the numbers given with uploads,
+// run with: pio test -e native
+
+#include <string>
+#include <vector>
+#include <unity.h>
+
+#include "config.h"
+#include "manifest.h"
+
+void setUp() {}
+void tearDown() {}
+
+static bool number(const char* text, uint32_t max, uint32_t expect)
+{
+    uint32_t value = ~expect;
+    return parse_number(text, max, value) && value == expect;
+}
+
+static bool rejected(const char* text, uint32_t max)
+{
+    uint32_t value = 12345;
+    return !parse_number(text, max, value) && value == 12345;
+}
+
+void test_number()
+{
+    TEST_ASSERT_TRUE(number("0", 400, 0));
+    TEST_ASSERT_TRUE(number("50", 400, 50));
+    TEST_ASSERT_TRUE(number("400", 400, 400));
+    TEST_ASSERT_TRUE(number("007", 400, 7));
+    TEST_ASSERT_TRUE(number("4294967295", UINT32_MAX, UINT32_MAX));
+}
+
+// Anything but digits is rejected instead of being cut off or clamped
+void test_number_rejected()
+{
+    TEST_ASSERT_TRUE(rejected("", 400));
+    TEST_ASSERT_TRUE(rejected("401", 400));
+    TEST_ASSERT_TRUE(rejected("-1", 400));
+    TEST_ASSERT_TRUE(rejected("+5", 400));
+    TEST_ASSERT_TRUE(rejected(" 5", 400));
+    TEST_ASSERT_TRUE(rejected("5 ", 400));
+    TEST_ASSERT_TRUE(rejected("50%", 400));
+    TEST_ASSERT_TRUE(rejected("1e2", 400));
+    TEST_ASSERT_TRUE(rejected("0x10", 400));
+    TEST_ASSERT_TRUE(rejected("4294967296", UINT32_MAX));
+    TEST_ASSERT_TRUE(rejected("99999999999999999999", 400));
+}
+
+void test_parse()
+{
+    std::vector<uint32_t> weights;
+
+    TEST_ASSERT_TRUE(manifest_parse("70\n21\n9\n", weights));
+    TEST_ASSERT_EQUAL(3, weights.size());
+    TEST_ASSERT_EQUAL_UINT32(70, weights[0]);
+    TEST_ASSERT_EQUAL_UINT32(21, weights[1]);
+    TEST_ASSERT_EQUAL_UINT32(9, weights[2]);
+
+    // Edited by hand: Windows line ends, blank lines, no final line end
+    TEST_ASSERT_TRUE(manifest_parse("\r\n5\r\n\r\n0 \r\n" "10000", weights));
+    TEST_ASSERT_EQUAL(3, weights.size());
+    TEST_ASSERT_EQUAL_UINT32(5, weights[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, weights[1]);
+    TEST_ASSERT_EQUAL_UINT32(MAX_SAMPLE_WEIGHT, weights[2]);
+}
+
+// A manifest with a bad weight is not used at all, the firmware falls back to the built-in slots
+void test_parse_rejected()
+{
+    std::vector<uint32_t> weights;
+
+    TEST_ASSERT_FALSE(manifest_parse("", weights));
+    TEST_ASSERT_FALSE(manifest_parse("\n\n", weights));
+    TEST_ASSERT_FALSE(manifest_parse("70\n-1\n", weights));
+    TEST_ASSERT_FALSE(manifest_parse("70\n10001\n", weights));
+    TEST_ASSERT_FALSE(manifest_parse("70\nabc\n", weights));
+    TEST_ASSERT_FALSE(manifest_parse("70\n21x\n", weights));
+}
+
+void test_max_samples()
+{
+    std::string text;
+    for (int i = 0; i < MAX_SAMPLES + 5; ++i) {
+        text += "1\n";
+    }
+
+    std::vector<uint32_t> weights;
+    TEST_ASSERT_TRUE(manifest_parse(text.c_str(), weights));
+    TEST_ASSERT_EQUAL(MAX_SAMPLES, weights.size());
+}
+
+void test_round_trip()
+{
+    const std::vector<uint32_t> weights = { 70, 0, MAX_SAMPLE_WEIGHT, 1 };
+    const std::string           text    = manifest_format(weights);
+
+    TEST_ASSERT_EQUAL_STRING("70\n0\n10000\n1\n", text.c_str());
+
+    std::vector<uint32_t> parsed;
+    TEST_ASSERT_TRUE(manifest_parse(text.c_str(), parsed));
+    TEST_ASSERT_TRUE(parsed == weights);
+}
+
+void test_defaults()
+{
+    const std::vector<uint32_t> weights = manifest_defaults();
+    uint32_t                    total   = 0;
+
+    TEST_ASSERT_EQUAL(N_SAMPLES, weights.size());
+    TEST_ASSERT_EQUAL_UINT32(PROBABILITY_MAIN_SAMPLE, weights[0]);
+    for (uint32_t weight : weights) {
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(MAX_SAMPLE_WEIGHT, weight);
+        total += weight;
+    }
+    TEST_ASSERT_EQUAL_UINT32(100, total);
+
+    std::vector<uint32_t> parsed;
+    TEST_ASSERT_TRUE(manifest_parse(manifest_format(weights).c_str(), parsed));
+    TEST_ASSERT_TRUE(parsed == weights);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_number);
+    RUN_TEST(test_number_rejected);
+    RUN_TEST(test_parse);
+    RUN_TEST(test_parse_rejected);
+    RUN_TEST(test_max_samples);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_defaults);
+    return UNITY_END();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Mixing of overlapping voices and the choice of the voice that is cut off
+// when all are busy, run with: pio test -e native
+
+#include <unity.h>
+
+#include "audio.h"
+#include "config.h"
+#include "mixer.h"
+
+#define N 4     // Samples per test buffer
+
+void setUp() {}
+void tearDown() {}
+
+// Mix AUDIO_VOICES voices of the same samples at gain and return the DAC
+// frames, checking that both channels are the same
+static void mix_voices(const uint8_t* pcm, int gain, uint8_t* out)
+{
+    int16_t  mix[N] = {};
+    uint16_t frames[N * 2];
+
+    for (int v = 0; v < AUDIO_VOICES; ++v) {
+        mix_add(mix, pcm, N, gain);
+    }
+    mix_output(mix, frames, N);
+
+    for (int i = 0; i < N; ++i) {
+        TEST_ASSERT_EQUAL_HEX16(frames[2 * i], frames[2 * i + 1]);
+        TEST_ASSERT_EQUAL_HEX16(0, frames[2 * i] & 0xff);
+        out[i] = frames[2 * i] >> 8;
+    }
+}
+
+// A single voice comes out unchanged
+void test_single_voice()
+{
+    const uint8_t pcm[N] = { 0, 100, 128, 255 };
+    int16_t       mix[N] = {};
+    uint16_t      frames[N * 2];
+
+    mix_add(mix, pcm, N, AUDIO_GAIN_UNITY);
+    mix_output(mix, frames, N);
+    for (int i = 0; i < N; ++i) {
+        TEST_ASSERT_EQUAL_HEX16(pcm[i] << 8, frames[2 * i]);
+    }
+}
+
+// Loud overlaps clip at the ends of the 8-bit range instead of wrapping around
+void test_saturation()
+{
+    const uint8_t pcm[N] = { 0, 64, 192, 255 };
+    uint8_t       out[N];
+
+    mix_voices(pcm, AUDIO_GAIN_UNITY, out);
+    TEST_ASSERT_EQUAL_UINT8(0, out[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, out[1]);
+    TEST_ASSERT_EQUAL_UINT8(255, out[2]);
+    TEST_ASSERT_EQUAL_UINT8(255, out[3]);
+
+    // Quiet ones add up
+    const uint8_t quiet[N] = { 120, 126, 130, 136 };
+    mix_voices(quiet, AUDIO_GAIN_UNITY, out);
+    TEST_ASSERT_EQUAL_UINT8(128 - 4 * 8, out[0]);
+    TEST_ASSERT_EQUAL_UINT8(128 - 4 * 2, out[1]);
+    TEST_ASSERT_EQUAL_UINT8(128 + 4 * 2, out[2]);
+    TEST_ASSERT_EQUAL_UINT8(128 + 4 * 8, out[3]);
+}
+
+// Even all voices at the highest gain an upload may have don't overflow the sums
+void test_max_gain()
+{
+    const int     gain   = MAX_SAMPLE_GAIN * AUDIO_GAIN_UNITY / 100;
+    const uint8_t pcm[N] = { 0, 255, 127, 129 };
+    uint8_t       out[N];
+
+    mix_voices(pcm, gain, out);
+    TEST_ASSERT_EQUAL_UINT8(0, out[0]);
+    TEST_ASSERT_EQUAL_UINT8(255, out[1]);
+    TEST_ASSERT_EQUAL_UINT8(128 - AUDIO_VOICES * MAX_SAMPLE_GAIN / 100, out[2]);
+    TEST_ASSERT_EQUAL_UINT8(128 + AUDIO_VOICES * MAX_SAMPLE_GAIN / 100, out[3]);
+}
+
+void test_gain()
+{
+    const uint8_t pcm[N] = { 0, 64, 192, 255 };
+    int16_t       mix[N] = {};
+
+    mix_add(mix, pcm, N, AUDIO_GAIN_UNITY / 2);
+    TEST_ASSERT_EQUAL_INT16(-64, mix[0]);
+    TEST_ASSERT_EQUAL_INT16(-32, mix[1]);
+    TEST_ASSERT_EQUAL_INT16(32, mix[2]);
+    TEST_ASSERT_EQUAL_INT16(63, mix[3]);
+
+    // Muted
+    mix_add(mix, pcm, N, 0);
+    TEST_ASSERT_EQUAL_INT16(-64, mix[0]);
+}
+
+// The voice started by the oldest request is cut off
+void test_oldest_voice()
+{
+    const uint32_t seq[] = { 5, 3, 9, 7 };
+    TEST_ASSERT_EQUAL(1, mix_oldest(seq, 4));
+
+    const uint32_t first[] = { 2, 3, 4, 5 };
+    TEST_ASSERT_EQUAL(0, mix_oldest(first, 4));
+}
+
+// Also after the request numbers wrapped around
+void test_oldest_voice_wrap()
+{
+    const uint32_t seq[] = { 1, 0xfffffffe, 0, 0xffffffff };
+    TEST_ASSERT_EQUAL(1, mix_oldest(seq, 4));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_voice);
+    RUN_TEST(test_saturation);
+    RUN_TEST(test_max_gain);
+    RUN_TEST(test_gain);
+    RUN_TEST(test_oldest_voice);
+    RUN_TEST(test_oldest_voice_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Bookkeeping of the samples kept in RAM: which ones are dropped to make
+// room, and in which order. Run with: pio test -e native
+
+#include <vector>
+#include <unity.h>
+
+#include "sample_cache.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Put len bytes of samples for slot idx into the cache
+static void load(SampleCache& cache, int idx, size_t len)
+{
+    std::vector<uint8_t> data(len, (uint8_t)idx);
+    cache[idx].len = len;
+    cache.insert(idx, data);
+}
+
+static SampleCache filled(size_t budget, int slots, size_t len)
+{
+    SampleCache cache(budget);
+    cache.resize(slots + 2);
+    for (int i = 0; i < slots; ++i) {
+        load(cache, i, len);
+    }
+    return cache;
+}
+
+// Hits and misses are only counted for samples played from RAM
+void test_pick()
+{
+    SampleCache cache = filled(300, 2, 100);
+    cache[2].len = 100;
+
+    TEST_ASSERT_TRUE(cache.pick(1, 0, 0));
+    TEST_ASSERT_FALSE(cache.pick(2, 0, 0));
+    TEST_ASSERT_TRUE(cache.pick(3, 0, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.hits());
+    TEST_ASSERT_EQUAL_UINT32(1, cache.misses());
+
+    // Not dropped before the play ends
+    TEST_ASSERT_TRUE(cache.pick(1, 900, 100));
+    TEST_ASSERT_EQUAL_UINT32(1000, cache[1].ends_ms);
+}
+
+// The least recently played samples go first
+void test_lru_order()
+{
+    SampleCache cache = filled(300, 3, 100);
+    std::vector<DroppedSample> dropped;
+
+    cache.pick(2, 0, 0);
+    cache.pick(1, 0, 0);
+
+    TEST_ASSERT_TRUE(cache.make_room(3, 100, 1000, dropped));
+    TEST_ASSERT_EQUAL(1, dropped.size());
+    TEST_ASSERT_EQUAL(2, dropped[0].idx);
+    TEST_ASSERT_EQUAL_UINT32(100, dropped[0].data.size());
+    TEST_ASSERT_FALSE(cache.resident(2));
+    TEST_ASSERT_EQUAL_UINT32(200, cache.bytes());
+
+    // Inserting counts as a play
+    load(cache, 3, 100);
+    dropped.clear();
+
+    TEST_ASSERT_TRUE(cache.make_room(2, 200, 1000, dropped));
+    TEST_ASSERT_EQUAL(2, dropped.size());
+    TEST_ASSERT_EQUAL(1, dropped[0].idx);
+    TEST_ASSERT_EQUAL(3, dropped[1].idx);
+    TEST_ASSERT_EQUAL_UINT32(100, cache.bytes());
+    TEST_ASSERT_EQUAL_UINT32(3, cache.evictions());
+
+    // The slots keep their description and are read again when picked
+    TEST_ASSERT_EQUAL_UINT32(100, cache[1].len);
+    TEST_ASSERT_FALSE(cache.pick(1, 1000, 0));
+}
+
+// Slot 0 is never dropped, even if it wasn't played for the longest time
+void test_slot_0_pinned()
+{
+    SampleCache cache = filled(200, 2, 100);
+    std::vector<DroppedSample> dropped;
+
+    cache.pick(1, 0, 0);
+
+    TEST_ASSERT_TRUE(cache.make_room(2, 100, 1000, dropped));
+    TEST_ASSERT_EQUAL(1, dropped.size());
+    TEST_ASSERT_EQUAL(1, dropped[0].idx);
+    TEST_ASSERT_TRUE(cache.resident(0));
+}
+
+// A sample that is still playing is only cut off if nothing else is left
+void test_playing_last()
+{
+    SampleCache cache = filled(300, 3, 100);
+    std::vector<DroppedSample> dropped;
+
+    cache.pick(1, 0, 5000);
+    cache.pick(2, 0, 0);
+
+    TEST_ASSERT_TRUE(cache.make_room(3, 100, 100, dropped));
+    TEST_ASSERT_EQUAL(1, dropped.size());
+    TEST_ASSERT_EQUAL(2, dropped[0].idx);
+
+    TEST_ASSERT_TRUE(cache.make_room(3, 200, 100, dropped));
+    TEST_ASSERT_EQUAL(2, dropped.size());
+    TEST_ASSERT_EQUAL(1, dropped[1].idx);
+}
+
+// Neither slot 0 nor the slot that needs the room are dropped for it
+void test_no_room()
+{
+    SampleCache cache = filled(200, 2, 100);
+    std::vector<DroppedSample> dropped;
+
+    TEST_ASSERT_FALSE(cache.make_room(1, 100, 0, dropped));
+    TEST_ASSERT_EQUAL(0, dropped.size());
+    TEST_ASSERT_TRUE(cache.resident(1));
+
+    TEST_ASSERT_FALSE(cache.make_room(2, 150, 0, dropped));
+    TEST_ASSERT_EQUAL(1, dropped.size());
+    TEST_ASSERT_EQUAL_UINT32(100, cache.bytes());
+}
+
+// Samples being read take their room before they are inserted
+void test_reserve()
+{
+    SampleCache cache = filled(300, 2, 100);
+    std::vector<DroppedSample> dropped;
+
+    cache.reserve(100);
+    TEST_ASSERT_TRUE(cache.make_room(2, 100, 0, dropped));
+    TEST_ASSERT_EQUAL(1, dropped.size());
+
+    cache.unreserve(100);
+    TEST_ASSERT_EQUAL_UINT32(100, cache.bytes());
+}
+
+void test_forget()
+{
+    SampleCache cache = filled(300, 2, 100);
+    std::vector<DroppedSample> dropped;
+
+    cache.forget(1, dropped);
+    TEST_ASSERT_EQUAL(1, dropped.size());
+    TEST_ASSERT_EQUAL_UINT32(0, cache[1].len);
+    TEST_ASSERT_EQUAL_UINT32(100, cache.bytes());
+    TEST_ASSERT_EQUAL_UINT32(0, cache.evictions());
+
+    // Nothing left to drop
+    cache.forget(1, dropped);
+    TEST_ASSERT_EQUAL(1, dropped.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pick);
+    RUN_TEST(test_lru_order);
+    RUN_TEST(test_slot_0_pinned);
+    RUN_TEST(test_playing_last);
+    RUN_TEST(test_no_room);
+    RUN_TEST(test_reserve);
+    RUN_TEST(test_forget);
+    return UNITY_END();
+}
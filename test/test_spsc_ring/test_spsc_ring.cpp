@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Producer/consumer stress test of the sample ring, run with: pio test -e native
+
+#include <atomic>
+#include <thread>
+#include <unity.h>
+
+#include "spsc_ring.h"
+
+#define STRESS_ITEMS 1000000
+
+// Same layout as the sampler's entries: a timestamp and a reading
+struct Item {
+    uint32_t seq;
+    uint32_t check;
+};
+
+static uint32_t check_of(uint32_t seq) { return seq * 2654435761u; }
+
+void setUp() {}
+void tearDown() {}
+
+void test_single_thread()
+{
+    SpscRing<uint32_t, 4> ring;
+    uint32_t v;
+
+    TEST_ASSERT_FALSE(ring.pop(v));
+
+    for (uint32_t i = 0; i < 4; ++i) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_FALSE(ring.push(4));     // Full, dropped
+    TEST_ASSERT_EQUAL_UINT(4, ring.size());
+
+    for (uint32_t i = 0; i < 4; ++i) {
+        TEST_ASSERT_TRUE(ring.pop(v));
+        TEST_ASSERT_EQUAL_UINT32(i, v);
+    }
+    TEST_ASSERT_FALSE(ring.pop(v));
+}
+
+// Many laps around a small ring
+void test_many_laps()
+{
+    SpscRing<uint32_t, 8> ring;
+    uint32_t v;
+
+    for (uint32_t i = 0; i < 100000; ++i) {
+        TEST_ASSERT_TRUE(ring.push(i));
+        TEST_ASSERT_TRUE(ring.push(i + 1));
+        TEST_ASSERT_TRUE(ring.pop(v));
+        TEST_ASSERT_EQUAL_UINT32(i, v);
+        TEST_ASSERT_TRUE(ring.pop(v));
+        TEST_ASSERT_EQUAL_UINT32(i + 1, v);
+    }
+}
+
+// The counters wrap around at 2^32, which must not be noticed: the ring
+// still fills up to its capacity, reports its size and keeps the order
+void test_counter_wrap()
+{
+    for (uint32_t back = 0; back <= 8; ++back) {
+        SpscRing<uint32_t, 8> ring(UINT32_MAX - back);
+        uint32_t v;
+
+        for (uint32_t i = 0; i < 8; ++i) {
+            TEST_ASSERT_TRUE(ring.push(i));
+            TEST_ASSERT_EQUAL_UINT(i + 1, ring.size());
+        }
+        TEST_ASSERT_FALSE(ring.push(8));    // Full, dropped
+        TEST_ASSERT_EQUAL_UINT(8, ring.size());
+
+        for (uint32_t i = 0; i < 8; ++i) {
+            TEST_ASSERT_TRUE(ring.pop(v));
+            TEST_ASSERT_EQUAL_UINT32(i, v);
+        }
+        TEST_ASSERT_FALSE(ring.pop(v));
+        TEST_ASSERT_EQUAL_UINT(0, ring.size());
+
+        // Laps after the wrap
+        for (uint32_t i = 0; i < 100; ++i) {
+            TEST_ASSERT_TRUE(ring.push(i));
+            TEST_ASSERT_TRUE(ring.pop(v));
+            TEST_ASSERT_EQUAL_UINT32(i, v);
+        }
+    }
+}
+
+// Producer retries while full: every item arrives exactly once, in order and intact
+void test_stress_lossless()
+{
+    static SpscRing<Item, 64> ring;
+
+    std::thread producer([] {
+        for (uint32_t i = 0; i < STRESS_ITEMS; ++i) {
+            const Item item = { i, check_of(i) };
+            while (!ring.push(item)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    uint32_t errors   = 0;
+    Item     item;
+
+    while (expected < STRESS_ITEMS) {
+        if (!ring.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (item.seq != expected || item.check != check_of(item.seq)) {
+            errors++;
+        }
+        expected = item.seq + 1;
+    }
+
+    producer.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_UINT(0, ring.size());
+}
+
+// Producer drops when full, like the sampler timer: whatever arrives is in
+// order and intact, and every item is either received or counted as dropped
+void test_stress_dropping()
+{
+    static SpscRing<Item, 16>    ring;
+    static std::atomic<uint32_t> dropped(0);
+    static std::atomic<bool>     done(false);
+
+    std::thread producer([] {
+        for (uint32_t i = 0; i < STRESS_ITEMS; ++i) {
+            const Item item = { i, check_of(i) };
+            if (!ring.push(item)) {
+                dropped++;
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint32_t received = 0;
+    uint32_t errors   = 0;
+    int64_t  last     = -1;
+    Item     item;
+
+    while (true) {
+        // Read before popping, so an empty ring afterwards means all items were seen
+        const bool finished = done.load(std::memory_order_acquire);
+
+        if (ring.pop(item)) {
+            if ((int64_t)item.seq <= last || item.check != check_of(item.seq)) {
+                errors++;
+            }
+            last = item.seq;
+            received++;
+        } else if (finished) {
+            break;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_UINT32(STRESS_ITEMS, received + dropped.load());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_thread);
+    RUN_TEST(test_many_laps);
+    RUN_TEST(test_counter_wrap);
+    RUN_TEST(test_stress_lossless);
+    RUN_TEST(test_stress_dropping);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2025 Yunis <schnackus>,
+ *                    Patrick Pedersen <ctx.xda@gmail.com>,
+ *                    TuDo Makerspace
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// The built-in sounds through the WAV parser and the resampler, the way
+// uploads are converted. Run with: pio test -e native
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <unity.h>
+
+#include "config.h"
+#include "resampler.h"
+#include "sounds.h"
+#include "wav.h"
+
+#define MIN_SNR_DB  20      // Lowest acceptable signal to noise ratio after converting there and back
+
+void setUp() {}
+void tearDown() {}
+
+// The sounds are 8-bit mono at SAMPLE_RATE, their data chunk has an odd size
+// and is followed by LIST and id3 chunks. With the fmt chunk first, parsing
+// ends where the samples start, so an upload can stream them right away.
+static void parse(const uint8_t* wav, size_t size, uint32_t data_len)
+{
+    ClipInfo info;
+    TEST_ASSERT_TRUE(wav_parse(wav, size, info));
+    TEST_ASSERT_EQUAL(WAV_FORMAT_PCM, info.format);
+    TEST_ASSERT_EQUAL(1, info.channels);
+    TEST_ASSERT_EQUAL(8, info.bits);
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_RATE, info.rate);
+    TEST_ASSERT_EQUAL_UINT32(WAV_PCM_HEADER, info.offset);
+    TEST_ASSERT_EQUAL_UINT32(data_len, info.len);
+    TEST_ASSERT_EQUAL_UINT32(data_len, info.samples);
+    TEST_ASSERT_EQUAL_UINT32((uint64_t)data_len * 1000 / SAMPLE_RATE, info.duration_ms);
+
+    // Uploads arrive in pieces of any size, the result must not depend on them
+    const size_t pieces[] = { 1, 7, 512, 1436 };
+    for (size_t piece : pieces) {
+        WavParser parser(size);
+        size_t    pos = 0;
+        while (pos < size && !parser.done() && !parser.failed()) {
+            const size_t n = (size - pos < piece) ? size - pos : piece;
+            pos += parser.feed(wav + pos, n);
+        }
+        TEST_ASSERT_TRUE(parser.done());
+        TEST_ASSERT_EQUAL_UINT32(info.offset, parser.position());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(&info, &parser.info(), sizeof(info));
+    }
+
+    // A file cut off within the data chunk keeps the samples that arrived
+    const size_t cut = WAV_PCM_HEADER + data_len / 2;
+    TEST_ASSERT_TRUE(wav_parse(wav, cut, info));
+    TEST_ASSERT_EQUAL_UINT32(cut - WAV_PCM_HEADER, info.samples);
+}
+
+void test_parse_coin()    { parse(coin, sizeof(coin), 6705); }
+void test_parse_powerup() { parse(powerup, sizeof(powerup), 7475); }
+void test_parse_oneup()   { parse(oneup, sizeof(oneup), 7940); }
+
+// Resample n samples, fed in pieces of piece samples
+static std::vector<uint8_t> resample(const uint8_t* in, size_t n, uint32_t from, uint32_t to, size_t piece)
+{
+    Resampler            rs(from, to);
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> buf(rs.max_output(piece) + rs.max_output(rs.taps()));
+
+    for (size_t done = 0; done < n; done += piece) {
+        const size_t c = (n - done < piece) ? n - done : piece;
+        const size_t k = rs.process(in + done, c, buf.data());
+        out.insert(out.end(), buf.begin(), buf.begin() + k);
+    }
+    const size_t k = rs.flush(buf.data());
+    out.insert(out.end(), buf.begin(), buf.begin() + k);
+    return out;
+}
+
+// Pretend the sound was recorded at rate, convert it to SAMPLE_RATE and back
+static void round_trip(const uint8_t* wav, size_t size, uint32_t rate)
+{
+    ClipInfo info;
+    TEST_ASSERT_TRUE(wav_parse(wav, size, info));
+    const uint8_t* pcm = wav + info.offset;
+
+    const std::vector<uint8_t> conv = resample(pcm, info.samples, rate, SAMPLE_RATE, 1436);
+    TEST_ASSERT_EQUAL_UINT32(Resampler(rate, SAMPLE_RATE).output_len(info.samples), conv.size());
+    TEST_ASSERT_UINT32_WITHIN(1, (uint64_t)info.samples * SAMPLE_RATE / rate, conv.size());
+
+    // Uploads arrive in pieces of any size, the result must not depend on them
+    const std::vector<uint8_t> single = resample(pcm, info.samples, rate, SAMPLE_RATE, 1);
+    TEST_ASSERT_TRUE(conv == single);
+
+    const std::vector<uint8_t> back = resample(conv.data(), conv.size(), SAMPLE_RATE, rate, 1436);
+    TEST_ASSERT_UINT32_WITHIN(1, info.samples, back.size());
+
+    double signal = 0;
+    double noise  = 0;
+    for (size_t i = 0; i < back.size() && i < info.samples; ++i) {
+        const int err = (int)back[i] - pcm[i];
+        signal += ((int)pcm[i] - 128) * ((int)pcm[i] - 128);
+        noise  += err * err;
+    }
+    TEST_ASSERT_GREATER_THAN(MIN_SNR_DB, 10 * log10(signal / noise));
+}
+
+// Upsampling to SAMPLE_RATE keeps the whole band of the sound
+void test_resample_coin()    { round_trip(coin, sizeof(coin), 11025); }
+void test_resample_powerup() { round_trip(powerup, sizeof(powerup), 8000); }
+void test_resample_oneup()   { round_trip(oneup, sizeof(oneup), 12000); }
+
+// A constant signal stays constant, the filter has unity gain
+void test_resample_dc()
+{
+    const uint32_t       rates[] = { RESAMPLE_MIN_RATE, 11025, 22050, 44100, RESAMPLE_MAX_RATE };
+    std::vector<uint8_t> in(4000, 200);
+
+    for (uint32_t rate : rates) {
+        const std::vector<uint8_t> out = resample(in.data(), in.size(), rate, SAMPLE_RATE, 256);
+        const size_t               edge = 32;     // The filter sees silence beyond both ends
+        for (size_t i = edge; i + edge < out.size(); ++i) {
+            TEST_ASSERT_INT_WITHIN(1, 200, out[i]);
+        }
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_coin);
+    RUN_TEST(test_parse_powerup);
+    RUN_TEST(test_parse_oneup);
+    RUN_TEST(test_resample_coin);
+    RUN_TEST(test_resample_powerup);
+    RUN_TEST(test_resample_oneup);
+    RUN_TEST(test_resample_dc);
+    return UNITY_END();
+}
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+coin_template.py – extract the matched-filter coin template from a recording
+
+Resamples a sensor recording (time_s,value CSV as written by record_ser.py)
+onto the detector's averaged sample grid, finds all coin dips, aligns them on
+their minimum and averages them into a template. The result is written as a
+C header for the firmware (src/coin_template.h).
+
+Usage
+-----
+$ python coin_template.py                                   # measurements/adc_readings_coin.csv
+$ python coin_template.py recording.csv -o ../src/coin_template.h
+"""
+import argparse
+import csv
+import os
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+PERIOD_US = 8000      # Averaged sample period on the device (SAMPLE_PERIOD_US * ADC_SAMPLES)
+THRESHOLD = 100       # Dip depth that marks a coin (SPIKE_THRESHOLD)
+ALPHA = 0.02          # Baseline smoothing (BASELINE_ALPHA)
+PRE = 4               # Template samples before the dip minimum
+POST = 5              # Template samples after the dip minimum
+
+
+def load(path):
+    with open(path, newline="") as f:
+        rows = [(float(t), int(v)) for t, v in list(csv.reader(f))[1:]]
+
+    # Recorded timestamps arrive in batches, spread the samples evenly instead
+    t0, t1 = rows[0][0], rows[-1][0]
+    n = len(rows)
+    return [t0 + (t1 - t0) * i / (n - 1) for i in range(n)], [v for _, v in rows]
+
+
+def resample(times, values, period_s):
+    out, j, t = [], 0, times[0]
+    while t <= times[-1]:
+        while times[j + 1] < t:
+            j += 1
+        f = (t - times[j]) / (times[j + 1] - times[j]) if times[j + 1] > times[j] else 0.0
+        out.append(values[j] + f * (values[j + 1] - values[j]))
+        t += period_s
+    return out
+
+
+def extract(stream):
+    windows, baseline, i = [], stream[0], 0
+    while i < len(stream):
+        diff = stream[i] - baseline
+        if diff < -THRESHOLD and PRE <= i < len(stream) - POST - 4:
+            lo = min(range(i, i + 4), key=lambda k: stream[k])
+            windows.append([stream[k] - baseline for k in range(lo - PRE, lo + POST + 1)])
+            i = lo + POST + 1
+            continue
+        if abs(diff) < THRESHOLD:
+            baseline += ALPHA * (stream[i] - baseline)  # Frozen during spikes, like the detector
+        i += 1
+    return windows
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Extract the matched-filter coin template")
+    ap.add_argument("csv", nargs="?", default=os.path.join(HERE, "..", "measurements", "adc_readings_coin.csv"))
+    ap.add_argument("-o", "--output", default=os.path.join(HERE, "..", "src", "coin_template.h"))
+    args = ap.parse_args()
+
+    times, values = load(args.csv)
+    stream = resample(times, values, PERIOD_US / 1e6)
+    windows = extract(stream)
+    if not windows:
+        raise SystemExit("No coins found in " + args.csv)
+
+    avg = [sum(w[k] for w in windows) / len(windows) for k in range(PRE + POST + 1)]
+    peak = max(abs(v) for v in avg)
+    tmpl = [round(v * 127 / peak) for v in avg]
+
+    with open(args.output, "w") as f:
+        f.write("#pragma once\n\n")
+        f.write("// Generated by tools/coin_template.py from %s (%d coins), do not edit.\n"
+                % (os.path.basename(args.csv), len(windows)))
+        f.write("// Average coin dip relative to the baseline, aligned on its minimum and\n")
+        f.write("// scaled to +-127. One value per COIN_TEMPLATE_PERIOD_US.\n\n")
+        f.write("#include <cstdint>\n\n")
+        f.write("#define COIN_TEMPLATE_PERIOD_US %d\n\n" % PERIOD_US)
+        f.write("const int8_t coin_template[] = { %s };\n" % ", ".join(str(v) for v in tmpl))
+
+    print("%d coins, template: %s" % (len(windows), tmpl))
+
+
+if __name__ == "__main__":
+    main()
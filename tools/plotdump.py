@@ -23,6 +23,7 @@ else:
         text = sys.stdin.read()
 
 # ── 2. extract numbers ------------------------------------------------------
+text = text.split("Detector", 1)[0]     # drop the detector state trailer
 parts = text.split("Averaged", 1)
 adc_vals = list(map(int, re.findall(r"\d+", parts[0])))
 avg_vals = list(map(int, re.findall(r"\d+", parts[1]))) if len(parts) == 2 else []
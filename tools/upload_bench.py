@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Measure the upload throughput of a box.
+
+Uploads a generated sine tone to a sample slot a few times and prints what
+the box reports in /stats for each upload: the time from the first chunk
+until the sample was loaded, the throughput and the number of writes to
+LittleFS. The slot's sample is replaced, pick one that may be overwritten.
+
+To compare firmware builds (e.g. UPLOAD_WRITE_BLOCK 0 against the default),
+flash one, run this, flash the other and run it again with the same options.
+"""
+import argparse
+import io
+import math
+import re
+import statistics
+import sys
+import urllib.request
+import uuid
+import wave
+
+DEFAULT_IP = "192.168.0.31"  # ESP32 address
+DEFAULT_RATE = 16000
+DEFAULT_DURATION = 5
+DEFAULT_RUNS = 5
+
+STATS_RE = re.compile(
+    r"Last upload: (\d+) B in (\d+) ms \((\d+) KB/s\), (\d+) B written in (\d+) writes"
+)
+
+
+def make_wav(rate, duration):
+    """8-bit mono WAV file holding a 440 Hz tone."""
+    n = int(rate * duration)
+    pcm = bytes(128 + int(100 * math.sin(2 * math.pi * 440 * i / rate)) for i in range(n))
+
+    buf = io.BytesIO()
+    with wave.open(buf, "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(1)
+        w.setframerate(rate)
+        w.writeframes(pcm)
+    return buf.getvalue()
+
+
+def get(ip, path):
+    with urllib.request.urlopen(f"http://{ip}{path}", timeout=30) as r:
+        return r.read().decode(errors="replace")
+
+
+def upload(ip, slot, wav, query):
+    boundary = uuid.uuid4().hex
+    body = (
+        f"--{boundary}\r\n"
+        f'Content-Disposition: form-data; name="file"; filename="bench.wav"\r\n'
+        f"Content-Type: audio/wav\r\n\r\n"
+    ).encode() + wav + f"\r\n--{boundary}--\r\n".encode()
+
+    req = urllib.request.Request(
+        f"http://{ip}/{slot}{query}",
+        data=body,
+        headers={"Content-Type": f"multipart/form-data; boundary={boundary}"},
+    )
+    with urllib.request.urlopen(req, timeout=60) as r:
+        return r.read().decode(errors="replace")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Measure the upload throughput of a box.")
+    ap.add_argument("-i", "--ip", default=DEFAULT_IP, help="ESP32 IP address")
+    ap.add_argument("-s", "--slot", required=True, type=int, help="sample slot to upload to (its sample is replaced)")
+    ap.add_argument("-r", "--rate", default=DEFAULT_RATE, type=int, help="sample rate of the tone (Hz)")
+    ap.add_argument("-t", "--time", default=DEFAULT_DURATION, type=float, help="duration of the tone (s)")
+    ap.add_argument("-n", "--runs", default=DEFAULT_RUNS, type=int, help="number of uploads")
+    ap.add_argument("--adpcm", action="store_true", help="store the tone as IMA-ADPCM")
+    ap.add_argument("--config", action="store_true", help="put the box into CONFIG mode first")
+    args = ap.parse_args()
+
+    if args.config:
+        get(args.ip, "/config")
+
+    wav = make_wav(args.rate, args.time)
+    query = "?adpcm" if args.adpcm else ""
+    print(f"Uploading {len(wav)} B ({args.rate} Hz, {args.time} s) to slot {args.slot}, {args.runs} times")
+
+    speeds = []
+    for run in range(args.runs):
+        upload(args.ip, args.slot, wav, query)
+        m = STATS_RE.search(get(args.ip, "/stats"))
+        if not m:
+            print("No upload in /stats, is the box in CONFIG mode?", file=sys.stderr)
+            return 1
+
+        size, ms, kbs, written, writes = (int(x) for x in m.groups())
+        speeds.append(kbs)
+        print(f"  {run + 1}: {size} B in {ms} ms ({kbs} KB/s), {written} B written in {writes} writes")
+
+    print(f"Median: {statistics.median(speeds)} KB/s")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())